@@ -380,6 +380,26 @@ struct ovectl_ratemanage2_arg
  */
 #define OV_ECTL_COUPLING_SET         0x41
 
+/**
+ *  Returns the current draft model setting in the int pointed to by arg.
+ *
+ * Argument: <tt>int *</tt>
+*/
+#define OV_ECTL_DRAFT_GET            0x50
+
+/**
+ *  Enables/disables the cheaper draft masking model according to arg.
+ *
+ * Argument: <tt>int *</tt>
+ *
+ *  Nonzero makes the psychoacoustic model skip the fixed width window of the
+ *  noise median fit, seed tone masking curves only from peaks above the
+ *  floor and skip spreading of the tone seeds.  Encoding is faster, files
+ *  are slightly larger and quality is somewhat worse.  Meant for iteration
+ *  builds, not for shipping assets.  Zero [default] is the normal model.
+ */
+#define OV_ECTL_DRAFT_SET            0x51
+
 /* deprecated rate management supported only for compatibility */
 
 /**
@@ -25,6 +25,7 @@
 #include "scales.h"
 #include "os.h"
 #include "misc.h"
+#include "profile.h"
 
 /* decides between modes, dispatches to the appropriate mapping. */
 int vorbis_analysis(vorbis_block *vb, ogg_packet *op){
@@ -118,3 +119,60 @@ void _analysis_output(char *base,int i,float *v,int n,int bark,int dB,
 
 
 
+
+/* per-stage encoder timing, see profile.h */
+
+static const char *profile_names[VP_PROFILE_STAGES]={
+  "envelope",
+  "mdct+fft",
+  "_vp_noisemask",
+  "_vp_tonemask",
+  "_vp_offset_and_mix",
+  "floor1_fit",
+  "couple_quantize",
+  "residue"
+};
+
+#ifdef VORBIS_PROFILE
+#include <time.h>
+
+#if defined(_MSC_VER)
+#  define PROFILE_THREAD __declspec(thread)
+#else
+#  define PROFILE_THREAD __thread
+#endif
+
+static PROFILE_THREAD long long profile_ns[VP_PROFILE_STAGES];
+
+long long _vp_profile_clock(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (long long)now.tv_sec*1000000000LL+now.tv_nsec;
+}
+
+void _vp_profile_add(int stage,long long start){
+  profile_ns[stage]+=_vp_profile_clock()-start;
+}
+
+void _vp_profile_reset(void){
+  memset(profile_ns,0,sizeof(profile_ns));
+}
+
+double _vp_profile_seconds(int stage){
+  return profile_ns[stage]*1e-9;
+}
+
+#else
+
+void _vp_profile_reset(void){
+}
+
+double _vp_profile_seconds(int stage){
+  return 0.;
+}
+
+#endif
+
+const char *_vp_profile_name(int stage){
+  return profile_names[stage];
+}
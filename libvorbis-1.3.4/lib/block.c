@@ -30,6 +30,8 @@
 #include "lpc.h"
 #include "registry.h"
 #include "misc.h"
+#include "backends.h"
+#include "profile.h"
 
 static int ilog2(unsigned int v){
   int ret=0;
@@ -84,6 +86,41 @@ static int ilog2(unsigned int v){
 #ifndef WORD_ALIGN
 #define WORD_ALIGN 8
 #endif
+#define WORD_ALIGNED(bytes) (((bytes)+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1))
+
+/* worst case of _vorbis_block_alloc use by one synthesis packet:
+   vorbis_synthesis pcm passback, floor1_inverse1 fit values and
+   residue partition words.  Anything not covered here (eg. floor0)
+   still falls back to the reap chain and is consolidated by the
+   ripcord */
+static long _vorbis_block_synthesis_storage(vorbis_info *vi){
+  codec_setup_info *ci=(vi?vi->codec_setup:NULL);
+  long bytes,partbytes=0;
+  int i;
+
+  if(!ci || vi->channels<1)return 0;
+
+  bytes=WORD_ALIGNED(vi->channels*sizeof(float *))+
+    vi->channels*WORD_ALIGNED(ci->blocksizes[1]*sizeof(float));
+
+  for(i=0;i<ci->floors;i++)
+    if(ci->floor_type[i]==1){
+      bytes+=vi->channels*WORD_ALIGNED((VIF_POSIT+2)*sizeof(int));
+      break;
+    }
+
+  for(i=0;i<ci->residues;i++){
+    vorbis_info_residue0 *info=(vorbis_info_residue0 *)ci->residue_param[i];
+    long partvals;
+    if(!info || info->grouping<1 || info->end<=info->begin)continue;
+    partvals=(info->end-info->begin)/info->grouping+1;
+    if(partbytes<partvals*(long)sizeof(int *))
+      partbytes=partvals*sizeof(int *);
+  }
+  bytes+=vi->channels*WORD_ALIGNED(partbytes);
+
+  return bytes;
+}
 
 int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
   int i;
@@ -91,7 +128,15 @@ int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
   vb->vd=v;
   vb->localalloc=0;
   vb->localstore=NULL;
-  if(v->analysisp){
+  if(!v->analysisp){
+    /* size the arena for a whole long block up front so steady state
+       decode never has to grow the reap chain */
+    long bytes=_vorbis_block_synthesis_storage(v->vi);
+    if(bytes>0){
+      vb->localstore=_ogg_malloc(bytes);
+      if(vb->localstore)vb->localalloc=bytes;
+    }
+  }else{
     vorbis_block_internal *vbi=
       vb->internal=_ogg_calloc(1,sizeof(vorbis_block_internal));
     vbi->ampmax=-9999;
@@ -111,7 +156,7 @@ int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
 }
 
 void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
-  bytes=(bytes+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1);
+  bytes=WORD_ALIGNED(bytes);
   if(bytes+vb->localtop>vb->localalloc){
     /* can't just _ogg_realloc... there are outstanding pointers */
     if(vb->localstore){
@@ -544,7 +589,8 @@ int vorbis_analysis_blockout(vorbis_dsp_state *v,vorbis_block *vb){
      be throwing more bits at impulses, and envelope search handles
      marking impulses too. */
   {
-    long bp=_ve_envelope_search(v);
+    long bp;
+    VP_PROFILE(VP_PROFILE_ENVELOPE,bp=_ve_envelope_search(v));
     if(bp==-1){
 
       if(v->eofflag==0)return(0); /* not enough data currently to search for a
@@ -723,7 +769,7 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
   codec_setup_info *ci=vi->codec_setup;
   private_state *b=v->backend_state;
   int hs=ci->halfrate_flag;
-  int i,j;
+  int j;
 
   if(!vb)return(OV_EINVAL);
   if(v->pcm_current>v->pcm_returned  && v->pcm_returned!=-1)return(OV_EINVAL);
@@ -774,15 +820,13 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
           const float *w=_vorbis_window_get(b->window[1]-hs);
           float *pcm=v->pcm[j]+prevCenter;
           float *p=vb->pcm[j];
-          for(i=0;i<n1;i++)
-            pcm[i]=pcm[i]*w[n1-i-1] + p[i]*w[i];
+          _vorbis_window_overlap_add(pcm,p,w,n1);
         }else{
           /* large/small */
           const float *w=_vorbis_window_get(b->window[0]-hs);
           float *pcm=v->pcm[j]+prevCenter+n1/2-n0/2;
           float *p=vb->pcm[j];
-          for(i=0;i<n0;i++)
-            pcm[i]=pcm[i]*w[n0-i-1] +p[i]*w[i];
+          _vorbis_window_overlap_add(pcm,p,w,n0);
         }
       }else{
         if(v->W){
@@ -790,27 +834,19 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
           const float *w=_vorbis_window_get(b->window[0]-hs);
           float *pcm=v->pcm[j]+prevCenter;
           float *p=vb->pcm[j]+n1/2-n0/2;
-          for(i=0;i<n0;i++)
-            pcm[i]=pcm[i]*w[n0-i-1] +p[i]*w[i];
-          for(;i<n1/2+n0/2;i++)
-            pcm[i]=p[i];
+          _vorbis_window_overlap_add(pcm,p,w,n0);
+          memcpy(pcm+n0,p+n0,(n1/2-n0/2)*sizeof(*pcm));
         }else{
           /* small/small */
           const float *w=_vorbis_window_get(b->window[0]-hs);
           float *pcm=v->pcm[j]+prevCenter;
           float *p=vb->pcm[j];
-          for(i=0;i<n0;i++)
-            pcm[i]=pcm[i]*w[n0-i-1] +p[i]*w[i];
+          _vorbis_window_overlap_add(pcm,p,w,n0);
         }
       }
 
       /* the copy section */
-      {
-        float *pcm=v->pcm[j]+thisCenter;
-        float *p=vb->pcm[j]+n;
-        for(i=0;i<n;i++)
-          pcm[i]=p[i];
-      }
+      memcpy(v->pcm[j]+thisCenter,vb->pcm[j]+n,n*sizeof(*v->pcm[j]));
     }
 
     if(v->centerW)
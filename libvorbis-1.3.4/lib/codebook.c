@@ -389,6 +389,9 @@ long vorbis_book_decodevs_add(codebook *book,float *a,oggpack_buffer *b,int n){
 
 /* decode vector / dim granularity gaurding is done in the upper layer */
 long vorbis_book_decodev_add(codebook *book,float *a,oggpack_buffer *b,int n){
+  if(book->decodev_add)
+    return book->decodev_add(book,a,b,n);
+
   if(book->used_entries>0){
     int i,j,entry;
     float *t;
@@ -464,6 +467,9 @@ long vorbis_book_decodevv_add(codebook *book,float **a,long offset,int ch,
 
   long i,j,entry;
   int chptr=0;
+  if(ch==2 && book->decodevv_add_stereo)
+    return book->decodevv_add_stereo(book,a,offset,b,n);
+
   if(book->used_entries>0){
     for(i=offset/ch;i<(offset+n)/ch;){
       entry = decode_packed_entry_number(book,b);
@@ -482,3 +488,75 @@ long vorbis_book_decodevv_add(codebook *book,float **a,long offset,int ch,
   }
   return(0);
 }
+
+/* Residue books are almost all dim 2, 4 or 8.  Versions of the two
+   residue vector loops above with dim fixed at compile time, so the
+   inner loop is fully unrolled and there's no per-entry dim loop or
+   switch.  Same order of adds as the generic loops. */
+
+#define BOOK_DECODEV_ADD(DIM)                                           \
+static long _book_decodev_add_##DIM(codebook *book,float *a,            \
+                                    oggpack_buffer *b,int n){           \
+  int i,j;                                                              \
+  for(i=0;i<n;i+=DIM){                                                  \
+    const float *t;                                                     \
+    long entry=decode_packed_entry_number(book,b);                      \
+    if(entry==-1)return(-1);                                            \
+    t=book->valuelist+entry*DIM;                                        \
+    for(j=0;j<DIM;j++)                                                  \
+      a[i+j]+=t[j];                                                     \
+  }                                                                     \
+  return(0);                                                            \
+}
+
+/* two channels interleaved; an even dim entry always ends on the
+   second channel so there's no channel pointer to carry over */
+#define BOOK_DECODEVV_ADD_STEREO(DIM)                                   \
+static long _book_decodevv_add_stereo_##DIM(codebook *book,float **a,   \
+                                            long offset,                \
+                                            oggpack_buffer *b,int n){   \
+  float *a0=a[0];                                                       \
+  float *a1=a[1];                                                       \
+  long i,j;                                                             \
+  for(i=offset/2;i<(offset+n)/2;){                                      \
+    const float *t;                                                     \
+    long entry=decode_packed_entry_number(book,b);                      \
+    if(entry==-1)return(-1);                                            \
+    t=book->valuelist+entry*DIM;                                        \
+    for(j=0;j<DIM;j+=2,i++){                                            \
+      a0[i]+=t[j];                                                      \
+      a1[i]+=t[j+1];                                                    \
+    }                                                                   \
+  }                                                                     \
+  return(0);                                                            \
+}
+
+BOOK_DECODEV_ADD(2)
+BOOK_DECODEV_ADD(4)
+BOOK_DECODEV_ADD(8)
+BOOK_DECODEVV_ADD_STEREO(2)
+BOOK_DECODEVV_ADD_STEREO(4)
+BOOK_DECODEVV_ADD_STEREO(8)
+
+void vorbis_book_select_decode(codebook *book){
+  book->decodev_add=NULL;
+  book->decodevv_add_stereo=NULL;
+
+  /* books without entries or values are handled by the generic code */
+  if(book->used_entries<=0 || !book->valuelist)return;
+
+  switch(book->dim){
+  case 2:
+    book->decodev_add=_book_decodev_add_2;
+    book->decodevv_add_stereo=_book_decodevv_add_stereo_2;
+    break;
+  case 4:
+    book->decodev_add=_book_decodev_add_4;
+    book->decodevv_add_stereo=_book_decodevv_add_stereo_4;
+    break;
+  case 8:
+    book->decodev_add=_book_decodev_add_8;
+    book->decodevv_add_stereo=_book_decodevv_add_stereo_8;
+    break;
+  }
+}
@@ -79,12 +79,20 @@ typedef struct codebook
 	int           quantvals;
 	int           minval;
 	int           delta;
+
+	/* residue decode loops specialized for this book's dim, chosen once
+	   by vorbis_book_select_decode; NULL means the generic loop */
+	long ( *decodev_add )( struct codebook* book, float* a,
+						   oggpack_buffer* b, int n );
+	long ( *decodevv_add_stereo )( struct codebook* book, float** a,
+								   long offset, oggpack_buffer* b, int n );
 } codebook;
 
 extern void vorbis_staticbook_destroy( static_codebook* b );
 extern int vorbis_book_init_encode( codebook* dest, const static_codebook* source );
 extern int vorbis_book_init_decode( codebook* dest, const static_codebook* source );
 extern void vorbis_book_clear( codebook* b );
+extern void vorbis_book_select_decode( codebook* b );
 
 extern float* _book_unquantize( const static_codebook* b, int n, int* map );
 extern float* _book_logdist( const static_codebook* b, float* vals );
@@ -25,6 +25,7 @@
 #include "codebook.h"
 #include "misc.h"
 #include "scales.h"
+#include "simd.h"
 
 #include <stdio.h>
 
@@ -362,6 +363,18 @@ static const float FLOOR1_fromdB_LOOKUP[256]={
   0.82788260F, 0.88168307F, 0.9389798F, 1.F,
 };
 
+/* d[i]*=f for a run of bins sharing one floor value */
+static void render_span(float *d,float f,int n){
+  int i=0;
+#ifdef VORBIS_SIMD
+  vorbis_v4f vf=v4f_set1(f);
+  for(;i+4<=n;i+=4)
+    v4f_store(d+i,v4f_mul(v4f_load(d+i),vf));
+#endif
+  for(;i<n;i++)
+    d[i]*=f;
+}
+
 static void render_line(int n, int x0,int x1,int y0,int y1,float *d){
   int dy=y1-y0;
   int adx=x1-x0;
@@ -376,6 +389,23 @@ static void render_line(int n, int x0,int x1,int y0,int y1,float *d){
 
   if(n>x1)n=x1;
 
+  if(base==0){
+    /* shallow line (the usual case in long blocks); y changes by at
+       most one step per bin so the line is a series of flat spans.
+       Find each span from the error term directly and multiply it in
+       bulk.  Same lookups and multiplies as the per bin walk below */
+    while(x<n){
+      /* first bin after x where err reaches adx */
+      int span=(ady?(adx-err+ady-1)/ady:n-x);
+      if(span>n-x)span=n-x;
+      render_span(d+x,FLOOR1_fromdB_LOOKUP[y],span);
+      x+=span;
+      err+=span*ady-adx;
+      y+=sy;
+    }
+    return;
+  }
+
   if(x<n)
     d[x]*=FLOOR1_fromdB_LOOKUP[y];
 
@@ -1088,7 +1118,7 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
         ly=hy;
       }
     }
-    for(j=hx;j<n;j++)out[j]*=FLOOR1_fromdB_LOOKUP[ly]; /* be certain */
+    if(hx<n)render_span(out+hx,FLOOR1_fromdB_LOOKUP[ly],n-hx); /* be certain */
     return(1);
   }
   memset(out,0,sizeof(*out)*n);
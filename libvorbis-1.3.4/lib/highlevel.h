@@ -44,6 +44,7 @@ typedef struct highlevel_encode_setup
 	int impulse_block_p;
 	int noise_normalize_p;
 	int coupling_p;
+	int draft_p;
 
 	double stereo_point_setting;
 	double lowpass_kHz;
@@ -27,6 +27,8 @@
 #include "registry.h"
 #include "psy.h"
 #include "misc.h"
+#include "simd.h"
+#include "profile.h"
 
 /* simplistic, wasteful way of doing this (unique lookup for each
    mode/submapping); there should be a central repository for
@@ -311,10 +313,11 @@ static int mapping0_forward(vorbis_block *vb){
 
     /* transform the PCM data */
     /* only MDCT right now.... */
-    mdct_forward(b->transform[vb->W][0],pcm,gmdct[i]);
-
-    /* FFT yields more accurate tonal estimation (not phase sensitive) */
-    drft_forward(&b->fft_look[vb->W],pcm);
+    VP_PROFILE(VP_PROFILE_TRANSFORM,
+               mdct_forward(b->transform[vb->W][0],pcm,gmdct[i]);
+               /* FFT yields more accurate tonal estimation (not phase
+                  sensitive) */
+               drft_forward(&b->fft_look[vb->W],pcm));
     logfft[0]=scale_dB+todB(pcm)  + .345; /* + .345 is a hack; the
                                      original todB estimation used on
                                      IEEE 754 compliant machines had a
@@ -422,10 +425,11 @@ static int mapping0_forward(vorbis_block *vb){
          us a tonality estimate (the larger the value in the
          'noise_depth' vector, the more tonal that area is) */
 
-      _vp_noisemask(psy_look,
-                    logmdct,
-                    noise); /* noise does not have by-frequency offset
-                               bias applied yet */
+      VP_PROFILE(VP_PROFILE_NOISEMASK,
+                 _vp_noisemask(psy_look,
+                               logmdct,
+                               noise)); /* noise does not have by-frequency
+                                           offset bias applied yet */
 #if 0
       if(vi->channels==2){
         if(i==0)
@@ -441,11 +445,12 @@ static int mapping0_forward(vorbis_block *vb){
          computed/fit for bitrate management goes in the second psy
          vector.  This includes tone masking, peak limiting and ATH */
 
-      _vp_tonemask(psy_look,
-                   logfft,
-                   tone,
-                   global_ampmax,
-                   local_ampmax[i]);
+      VP_PROFILE(VP_PROFILE_TONEMASK,
+                 _vp_tonemask(psy_look,
+                              logfft,
+                              tone,
+                              global_ampmax,
+                              local_ampmax[i]));
 
 #if 0
       if(vi->channels==2){
@@ -468,13 +473,14 @@ static int mapping0_forward(vorbis_block *vb){
       float aotuv[psy_look->n];
 #endif
 
-        _vp_offset_and_mix(psy_look,
-                           noise,
-                           tone,
-                           1,
-                           logmask,
-                           mdct,
-                           logmdct);
+        VP_PROFILE(VP_PROFILE_OFFSET_AND_MIX,
+                   _vp_offset_and_mix(psy_look,
+                                      noise,
+                                      tone,
+                                      1,
+                                      logmask,
+                                      mdct,
+                                      logmdct));
 
 #if 0
         if(vi->channels==2){
@@ -505,23 +511,25 @@ static int mapping0_forward(vorbis_block *vb){
          broken the encode setup lib.  Guard it anyway. */
       if(ci->floor_type[info->floorsubmap[submap]]!=1)return(-1);
 
-      floor_posts[i][PACKETBLOBS/2]=
-        floor1_fit(vb,b->flr[info->floorsubmap[submap]],
-                   logmdct,
-                   logmask);
+      VP_PROFILE(VP_PROFILE_FLOOR1_FIT,
+                 floor_posts[i][PACKETBLOBS/2]=
+                   floor1_fit(vb,b->flr[info->floorsubmap[submap]],
+                              logmdct,
+                              logmask));
 
       /* are we managing bitrate?  If so, perform two more fits for
          later rate tweaking (fits represent hi/lo) */
       if(vorbis_bitrate_managed(vb) && floor_posts[i][PACKETBLOBS/2]){
         /* higher rate by way of lower noise curve */
 
-        _vp_offset_and_mix(psy_look,
-                           noise,
-                           tone,
-                           2,
-                           logmask,
-                           mdct,
-                           logmdct);
+        VP_PROFILE(VP_PROFILE_OFFSET_AND_MIX,
+                   _vp_offset_and_mix(psy_look,
+                                      noise,
+                                      tone,
+                                      2,
+                                      logmask,
+                                      mdct,
+                                      logmdct));
 
 #if 0
         if(vi->channels==2){
@@ -534,19 +542,21 @@ static int mapping0_forward(vorbis_block *vb){
         }
 #endif
 
-        floor_posts[i][PACKETBLOBS-1]=
-          floor1_fit(vb,b->flr[info->floorsubmap[submap]],
-                     logmdct,
-                     logmask);
+        VP_PROFILE(VP_PROFILE_FLOOR1_FIT,
+                   floor_posts[i][PACKETBLOBS-1]=
+                     floor1_fit(vb,b->flr[info->floorsubmap[submap]],
+                                logmdct,
+                                logmask));
 
         /* lower rate by way of higher noise curve */
-        _vp_offset_and_mix(psy_look,
-                           noise,
-                           tone,
-                           0,
-                           logmask,
-                           mdct,
-                           logmdct);
+        VP_PROFILE(VP_PROFILE_OFFSET_AND_MIX,
+                   _vp_offset_and_mix(psy_look,
+                                      noise,
+                                      tone,
+                                      0,
+                                      logmask,
+                                      mdct,
+                                      logmdct));
 
 #if 0
         if(vi->channels==2){
@@ -559,10 +569,11 @@ static int mapping0_forward(vorbis_block *vb){
         }
 #endif
 
-        floor_posts[i][0]=
-          floor1_fit(vb,b->flr[info->floorsubmap[submap]],
-                     logmdct,
-                     logmask);
+        VP_PROFILE(VP_PROFILE_FLOOR1_FIT,
+                   floor_posts[i][0]=
+                     floor1_fit(vb,b->flr[info->floorsubmap[submap]],
+                                logmdct,
+                                logmask));
 
         /* we also interpolate a range of intermediate curves for
            intermediate rates */
@@ -643,15 +654,16 @@ static int mapping0_forward(vorbis_block *vb){
       /* quantize/couple */
       /* incomplete implementation that assumes the tree is all depth
          one, or no tree at all */
-      _vp_couple_quantize_normalize(k,
-                                    &ci->psy_g_param,
-                                    psy_look,
-                                    info,
-                                    gmdct,
-                                    iwork,
-                                    nonzero,
-                                    ci->psy_g_param.sliding_lowpass[vb->W][k],
-                                    vi->channels);
+      VP_PROFILE(VP_PROFILE_COUPLE_QUANTIZE,
+                 _vp_couple_quantize_normalize(k,
+                                               &ci->psy_g_param,
+                                               psy_look,
+                                               info,
+                                               gmdct,
+                                               iwork,
+                                               nonzero,
+                                               ci->psy_g_param.sliding_lowpass[vb->W][k],
+                                               vi->channels));
 
 #if 0
       for(i=0;i<vi->channels;i++){
@@ -678,17 +690,21 @@ static int mapping0_forward(vorbis_block *vb){
           }
         }
 
-        classifications=_residue_P[ci->residue_type[resnum]]->
-          class(vb,b->residue[resnum],couple_bundle,zerobundle,ch_in_bundle);
+        VP_PROFILE(VP_PROFILE_RESIDUE,
+                   classifications=_residue_P[ci->residue_type[resnum]]->
+                     class(vb,b->residue[resnum],couple_bundle,zerobundle,
+                           ch_in_bundle));
 
         ch_in_bundle=0;
         for(j=0;j<vi->channels;j++)
           if(info->chmuxlist[j]==i)
             couple_bundle[ch_in_bundle++]=iwork[j];
 
-        _residue_P[ci->residue_type[resnum]]->
-          forward(opb,vb,b->residue[resnum],
-                  couple_bundle,zerobundle,ch_in_bundle,classifications,i);
+        VP_PROFILE(VP_PROFILE_RESIDUE,
+                   _residue_P[ci->residue_type[resnum]]->
+                     forward(opb,vb,b->residue[resnum],
+                             couple_bundle,zerobundle,ch_in_bundle,
+                             classifications,i));
       }
 
       /* ok, done encoding.  Next protopacket. */
@@ -703,6 +719,71 @@ static int mapping0_forward(vorbis_block *vb){
   return(0);
 }
 
+/* undo polar (magnitude/angle) channel coupling:
+
+     mag>0, ang>0:   M=mag      A=mag-ang
+     mag>0, ang<=0:  M=mag+ang  A=mag
+     mag<=0, ang>0:  M=mag      A=mag+ang
+     mag<=0, ang<=0: M=mag-ang  A=mag
+
+   which is t=mag-(+/-ang), with ang negated when exactly one of them
+   is positive, then the sign of ang picks which channel gets t.  The
+   vector version does exactly that with masks instead of branches;
+   x-(-y) is exactly x+y so results match the branchy code bit for
+   bit */
+void _vorbis_couple_inverse(float *pcmM,float *pcmA,long n){
+  long j=0;
+#if defined(VORBIS_SIMD_NEON)
+  const float32x4_t zero=vdupq_n_f32(0.f);
+  const uint32x4_t sign=vdupq_n_u32(0x80000000U);
+  for(;j+4<=n;j+=4){
+    float32x4_t mag=vld1q_f32(pcmM+j);
+    float32x4_t ang=vld1q_f32(pcmA+j);
+    uint32x4_t pm=vcgtq_f32(mag,zero);
+    uint32x4_t pa=vcgtq_f32(ang,zero);
+    uint32x4_t flip=vandq_u32(veorq_u32(pm,pa),sign);
+    float32x4_t t=vsubq_f32(mag,vreinterpretq_f32_u32(
+                   veorq_u32(vreinterpretq_u32_f32(ang),flip)));
+    vst1q_f32(pcmM+j,vbslq_f32(pa,mag,t));
+    vst1q_f32(pcmA+j,vbslq_f32(pa,t,mag));
+  }
+#elif defined(VORBIS_SIMD_SSE)
+  const __m128 zero=_mm_setzero_ps();
+  const __m128 sign=_mm_set1_ps(-0.f);
+  for(;j+4<=n;j+=4){
+    __m128 mag=_mm_loadu_ps(pcmM+j);
+    __m128 ang=_mm_loadu_ps(pcmA+j);
+    __m128 pm=_mm_cmpgt_ps(mag,zero);
+    __m128 pa=_mm_cmpgt_ps(ang,zero);
+    __m128 flip=_mm_and_ps(_mm_xor_ps(pm,pa),sign);
+    __m128 t=_mm_sub_ps(mag,_mm_xor_ps(ang,flip));
+    _mm_storeu_ps(pcmM+j,_mm_or_ps(_mm_and_ps(pa,mag),_mm_andnot_ps(pa,t)));
+    _mm_storeu_ps(pcmA+j,_mm_or_ps(_mm_and_ps(pa,t),_mm_andnot_ps(pa,mag)));
+  }
+#endif
+  for(;j<n;j++){
+    float mag=pcmM[j];
+    float ang=pcmA[j];
+
+    if(mag>0)
+      if(ang>0){
+        pcmM[j]=mag;
+        pcmA[j]=mag-ang;
+      }else{
+        pcmA[j]=mag;
+        pcmM[j]=mag+ang;
+      }
+    else
+      if(ang>0){
+        pcmM[j]=mag;
+        pcmA[j]=mag+ang;
+      }else{
+        pcmA[j]=mag;
+        pcmM[j]=mag-ang;
+      }
+  }
+}
+
 static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
   vorbis_dsp_state     *vd=vb->vd;
   vorbis_info          *vi=vd->vi;
@@ -718,6 +799,7 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
 
   int   *nonzero  =alloca(sizeof(*nonzero)*vi->channels);
   void **floormemo=alloca(sizeof(*floormemo)*vi->channels);
+  long   residue_end=0;
 
   /* recover the spectral envelope; store it in the PCM vector for now */
   for(i=0;i<vi->channels;i++){
@@ -756,34 +838,27 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
     _residue_P[ci->residue_type[info->residuesubmap[i]]]->
       inverse(vb,b->residue[info->residuesubmap[i]],
               pcmbundle,zerobundle,ch_in_bundle);
+
+    /* track the highest bin any residue could have written */
+    if(ch_in_bundle){
+      vorbis_info_residue0 *r=
+        (vorbis_info_residue0 *)ci->residue_param[info->residuesubmap[i]];
+      long end=r->end;
+      if(ci->residue_type[info->residuesubmap[i]]==2)
+        end=(end+ch_in_bundle-1)/ch_in_bundle; /* interleaved */
+      if(end>n/2)end=n/2;
+      if(end>residue_end)residue_end=end;
+    }
   }
 
-  /* channel coupling */
+  /* channel coupling; bins past the coded residue range are zero in
+     both channels and decouple to zero, so leave them alone */
   for(i=info->coupling_steps-1;i>=0;i--){
-    float *pcmM=vb->pcm[info->coupling_mag[i]];
-    float *pcmA=vb->pcm[info->coupling_ang[i]];
-
-    for(j=0;j<n/2;j++){
-      float mag=pcmM[j];
-      float ang=pcmA[j];
-
-      if(mag>0)
-        if(ang>0){
-          pcmM[j]=mag;
-          pcmA[j]=mag-ang;
-        }else{
-          pcmA[j]=mag;
-          pcmM[j]=mag+ang;
-        }
-      else
-        if(ang>0){
-          pcmM[j]=mag;
-          pcmA[j]=mag+ang;
-        }else{
-          pcmA[j]=mag;
-          pcmM[j]=mag-ang;
-        }
-    }
+    if(!nonzero[info->coupling_mag[i]] &&
+       !nonzero[info->coupling_ang[i]])continue; /* both silent */
+    _vorbis_couple_inverse(vb->pcm[info->coupling_mag[i]],
+                    vb->pcm[info->coupling_ang[i]],
+                    residue_end);
   }
 
   /* compute and apply spectral envelope */
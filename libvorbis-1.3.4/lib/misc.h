@@ -22,6 +22,10 @@
 extern void* _vorbis_block_alloc( vorbis_block* vb, long bytes );
 extern void _vorbis_block_ripcord( vorbis_block* vb );
 
+/* undo polar channel coupling of first n bins of one channel pair, in
+   place (mapping0.c) */
+extern void _vorbis_couple_inverse( float* pcmM, float* pcmA, long n );
+
 #ifdef ANALYSIS
 extern int analysis_noisy;
 extern void _analysis_output( char* base, int i, float* v, int n, int bark, int dB,
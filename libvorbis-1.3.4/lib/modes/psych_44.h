@@ -622,6 +622,8 @@ static const vorbis_info_psy _psy_info_template =
 	{{ -1}, { -1}, { -1}}, { -1}, 105.f,
 	/* noise normalization - noise_p, start, partition, thresh. */
 	0, -1, -1, 0.,
+	/* draft */
+	0,
 };
 
 /* ath ****************/
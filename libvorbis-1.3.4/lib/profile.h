@@ -0,0 +1,66 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: per-stage encoder timing for offline benchmarks
+
+ ********************************************************************/
+
+#ifndef _V_PROFILE_H_
+#define _V_PROFILE_H_
+
+/* Only compiled in with -DVORBIS_PROFILE (koala_encode does that with
+   PROFILE=1).  Counters are per thread, so an encoder running on its
+   own thread can reset them before a file and read them after. */
+
+enum {
+  VP_PROFILE_ENVELOPE,
+  VP_PROFILE_TRANSFORM,
+  VP_PROFILE_NOISEMASK,
+  VP_PROFILE_TONEMASK,
+  VP_PROFILE_OFFSET_AND_MIX,
+  VP_PROFILE_FLOOR1_FIT,
+  VP_PROFILE_COUPLE_QUANTIZE,
+  VP_PROFILE_RESIDUE,
+  VP_PROFILE_STAGES
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef VORBIS_PROFILE
+
+extern long long _vp_profile_clock(void);
+extern void _vp_profile_add(int stage,long long start);
+
+#  define VP_PROFILE(stage,statement) do{ \
+    long long _vp_start=_vp_profile_clock(); \
+    statement; \
+    _vp_profile_add((stage),_vp_start); \
+  }while(0)
+
+#else
+
+#  define VP_PROFILE(stage,statement) do{ statement; }while(0)
+
+#endif
+
+/* These are always available; without VORBIS_PROFILE all times are 0 */
+extern void _vp_profile_reset(void);
+extern double _vp_profile_seconds(int stage);
+extern const char *_vp_profile_name(int stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,6 +28,7 @@
 #include "smallft.h"
 #include "scales.h"
 #include "misc.h"
+#include "simd.h"
 
 #define NEGINF -9999.f
 static const double stereo_threshholds[]={0.0, .5, 1.0, 1.5, 2.5, 4.5, 8.5, 16.5, 9e10};
@@ -383,15 +384,23 @@ void _vp_psy_clear(vorbis_look_psy *p){
   }
 }
 
+/* While tone curves are laid down the seed vector is kept phase major:
+   seed line s lives at seed[(s%linesper)*rowlen+s/linesper].  A curve
+   steps through the seeds linesper lines at a time, so in this layout
+   it updates one contiguous run, which we can do four lines at once.
+   _vp_tonemask transposes the seeds back before seed_chase. */
+
 /* octave/(8*eighth_octave_lines) x scale and dB y scale */
 static void seed_curve(float *seed,
                        const float **curves,
                        float amp,
                        int oc, int n,
-                       int linesper,float dBoffset){
-  int i,post1;
+                       int linesper,float dBoffset,
+                       long rowlen){
+  int i,j,count,post1;
   int seedptr;
   const float *posts,*curve;
+  float *row;
 
   int choice=(int)((amp+dBoffset-P_LEVEL_0)*.1f);
   choice=max(choice,0);
@@ -401,13 +410,30 @@ static void seed_curve(float *seed,
   post1=(int)posts[1];
   seedptr=oc+(posts[0]-EHMER_OFFSET)*linesper-(linesper>>1);
 
-  for(i=posts[0];i<post1;i++){
-    if(seedptr>0){
-      float lin=amp+curve[i];
-      if(seed[seedptr]<lin)seed[seedptr]=lin;
-    }
+  /* seed line 0 is never written */
+  for(i=posts[0];i<post1 && seedptr<=0;i++)
     seedptr+=linesper;
-    if(seedptr>=n)break;
+  if(i>=post1 || seedptr>=n)return;
+
+  count=(n-seedptr+linesper-1)/linesper;
+  if(count>post1-i)count=post1-i;
+
+  row=seed+(seedptr%linesper)*rowlen+seedptr/linesper;
+  curve+=i;
+  j=0;
+
+#ifdef VORBIS_SIMD
+  {
+    vorbis_v4f a=v4f_set1(amp);
+    for(;j+4<=count;j+=4)
+      v4f_store(row+j,v4f_max(v4f_add(a,v4f_load(curve+j)),
+                              v4f_load(row+j)));
+  }
+#endif
+
+  for(;j<count;j++){
+    float lin=amp+curve[j];
+    if(row[j]<lin)row[j]=lin;
   }
 }
 
@@ -416,10 +442,14 @@ static void seed_loop(vorbis_look_psy *p,
                       const float *f,
                       const float *flr,
                       float *seed,
+                      long rowlen,
                       float specmax){
   vorbis_info_psy *vi=p->vi;
   long n=p->n,i;
   float dBoffset=vi->max_curve_dB-specmax;
+  /* the draft model skips peaks that barely clear the ATH and tone
+     floor, they only ever raise the mask a little */
+  float headroom=vi->draft_p?0.f:6.f;
 
   /* prime the working vector with peak values */
 
@@ -431,7 +461,7 @@ static void seed_loop(vorbis_look_psy *p,
       if(f[i]>max)max=f[i];
     }
 
-    if(max+6.f>flr[i]){
+    if(max+headroom>flr[i]){
       oc=oc>>p->shiftoc;
 
       if(oc>=P_BANDS)oc=P_BANDS-1;
@@ -443,7 +473,8 @@ static void seed_loop(vorbis_look_psy *p,
                  p->octave[i]-p->firstoc,
                  p->total_octave_lines,
                  p->eighth_octave_lines,
-                 dBoffset);
+                 dBoffset,
+                 rowlen);
     }
   }
 }
@@ -514,7 +545,10 @@ static void max_seeds(vorbis_look_psy *p,
   long   linpos=0;
   long   pos;
 
-  seed_chase(seed,linesper,n); /* for masking */
+  /* the draft model uses the bare seeds, the chase costs as much as
+     laying the curves down */
+  if(!p->vi->draft_p)
+    seed_chase(seed,linesper,n); /* for masking */
 
   pos=p->octave[0]-p->firstoc-(linesper>>1);
 
@@ -541,6 +575,21 @@ static void max_seeds(vorbis_look_psy *p,
 
 }
 
+#ifdef VORBIS_SIMD
+/* Least squares fit of one 4 line group, same operations in the same
+   order as the scalar loops below so the result is bit exact */
+static inline vorbis_v4f bark_noise_fit(vorbis_v4f tN,vorbis_v4f tX,
+                                        vorbis_v4f tXX,vorbis_v4f tY,
+                                        vorbis_v4f tXY,vorbis_v4f x){
+  vorbis_v4f A=v4f_sub(v4f_mul(tY,tXX),v4f_mul(tX,tXY));
+  vorbis_v4f B=v4f_sub(v4f_mul(tN,tXY),v4f_mul(tX,tY));
+  vorbis_v4f D=v4f_sub(v4f_mul(tN,tXX),v4f_mul(tX,tX));
+  return v4f_div(v4f_add(A,v4f_mul(x,B)),D);
+}
+
+static const float bark_noise_ramp[4]={0.f,1.f,2.f,3.f};
+#endif
+
 static void bark_noise_hybridmp(int n,const long *b,
                                 const float *f,
                                 float *noise,
@@ -555,6 +604,12 @@ static void bark_noise_hybridmp(int n,const long *b,
 
   float tN, tX, tXX, tY, tXY;
   int i;
+#ifdef VORBIS_SIMD
+  int k, end;
+  const vorbis_v4f voffset=v4f_set1(offset);
+  const vorbis_v4f vzero=v4f_set1(0.f);
+  const vorbis_v4f ramp=v4f_load(bark_noise_ramp);
+#endif
 
   int lo, hi;
   float R=0.f;
@@ -622,6 +677,31 @@ static void bark_noise_hybridmp(int n,const long *b,
     noise[i] = R - offset;
   }
 
+#ifdef VORBIS_SIMD
+  /* four fits at once; the scalar loop still does at least the last
+     one because its A, B and D carry on into the tail */
+  for (end = i; end < n && (b[end] & 0xffff) < n; end++);
+  for ( ; i + 4 < end; i += 4, x += 4.f) {
+    float gN[4], gX[4], gXX[4], gY[4], gXY[4];
+    vorbis_v4f vR;
+
+    for (k = 0; k < 4; k++) {
+      lo = b[i + k] >> 16;
+      hi = b[i + k] & 0xffff;
+      gN[k] = N[hi] - N[lo];
+      gX[k] = X[hi] - X[lo];
+      gXX[k] = XX[hi] - XX[lo];
+      gY[k] = Y[hi] - Y[lo];
+      gXY[k] = XY[hi] - XY[lo];
+    }
+
+    vR = bark_noise_fit(v4f_load(gN), v4f_load(gX), v4f_load(gXX),
+                        v4f_load(gY), v4f_load(gXY),
+                        v4f_add(v4f_set1(x), ramp));
+    v4f_store(noise + i, v4f_sub(v4f_max(vzero, vR), voffset));
+  }
+#endif
+
   for ( ;; i++, x += 1.f) {
 
     lo = b[i] >> 16;
@@ -642,6 +722,20 @@ static void bark_noise_hybridmp(int n,const long *b,
 
     noise[i] = R - offset;
   }
+
+#ifdef VORBIS_SIMD
+  {
+    const vorbis_v4f vA = v4f_set1(A);
+    const vorbis_v4f vB = v4f_set1(B);
+    const vorbis_v4f vD = v4f_set1(D);
+    for ( ; i + 4 <= n; i += 4, x += 4.f) {
+      vorbis_v4f vR = v4f_div(v4f_add(vA, v4f_mul(v4f_add(v4f_set1(x), ramp),
+                                                  vB)), vD);
+      v4f_store(noise + i, v4f_sub(v4f_max(vzero, vR), voffset));
+    }
+  }
+#endif
+
   for ( ; i < n; i++, x += 1.f) {
 
     R = (A + x * B) / D;
@@ -671,6 +765,25 @@ static void bark_noise_hybridmp(int n,const long *b,
 
     if (R - offset < noise[i]) noise[i] = R - offset;
   }
+
+#ifdef VORBIS_SIMD
+  /* lo and hi move by one line per fit here, so plain loads do */
+  for (end = n - fixed / 2; i + 4 < end; i += 4, x += 4.f) {
+    vorbis_v4f vR;
+
+    hi = i + fixed / 2;
+    lo = hi - fixed;
+
+    vR = bark_noise_fit(v4f_sub(v4f_load(N + hi), v4f_load(N + lo)),
+                        v4f_sub(v4f_load(X + hi), v4f_load(X + lo)),
+                        v4f_sub(v4f_load(XX + hi), v4f_load(XX + lo)),
+                        v4f_sub(v4f_load(Y + hi), v4f_load(Y + lo)),
+                        v4f_sub(v4f_load(XY + hi), v4f_load(XY + lo)),
+                        v4f_add(v4f_set1(x), ramp));
+    v4f_store(noise + i, v4f_min(v4f_sub(vR, voffset), v4f_load(noise + i)));
+  }
+#endif
+
   for ( ;; i++, x += 1.f) {
 
     hi = i + fixed / 2;
@@ -690,6 +803,20 @@ static void bark_noise_hybridmp(int n,const long *b,
 
     if (R - offset < noise[i]) noise[i] = R - offset;
   }
+
+#ifdef VORBIS_SIMD
+  {
+    const vorbis_v4f vA = v4f_set1(A);
+    const vorbis_v4f vB = v4f_set1(B);
+    const vorbis_v4f vD = v4f_set1(D);
+    for ( ; i + 4 <= n; i += 4, x += 4.f) {
+      vorbis_v4f vR = v4f_div(v4f_add(vA, v4f_mul(v4f_add(v4f_set1(x), ramp),
+                                                  vB)), vD);
+      v4f_store(noise + i, v4f_min(v4f_sub(vR, voffset), v4f_load(noise + i)));
+    }
+  }
+#endif
+
   for ( ; i < n; i++, x += 1.f) {
     R = (A + x * B) / D;
     if (R - offset < noise[i]) noise[i] = R - offset;
@@ -708,8 +835,9 @@ void _vp_noisemask(vorbis_look_psy *p,
 
   for(i=0;i<n;i++)work[i]=logmdct[i]-logmask[i];
 
+  /* the draft model skips the fixed width window of the median fit */
   bark_noise_hybridmp(n,p->bark,work,logmask,0.,
-                      p->vi->noisewindowfixed);
+                      p->vi->draft_p?-1:p->vi->noisewindowfixed);
 
   for(i=0;i<n;i++)work[i]=logmdct[i]-work[i];
 
@@ -750,21 +878,41 @@ void _vp_tonemask(vorbis_look_psy *p,
                   float global_specmax,
                   float local_specmax){
 
-  int i,n=p->n;
+  int i,j,k,n=p->n;
+  int linesper=p->eighth_octave_lines;
+  long lines=p->total_octave_lines;
+  long rowlen=(lines+linesper-1)/linesper;
 
-  float *seed=alloca(sizeof(*seed)*p->total_octave_lines);
+  float *seed=alloca(sizeof(*seed)*lines);
+  float *phased=alloca(sizeof(*phased)*rowlen*linesper);
   float att=local_specmax+p->vi->ath_adjatt;
-  for(i=0;i<p->total_octave_lines;i++)seed[i]=NEGINF;
+  for(i=0;i<rowlen*linesper;i++)phased[i]=NEGINF;
 
   /* set the ATH (floating below localmax, not global max by a
      specified att) */
   if(att<p->vi->ath_maxatt)att=p->vi->ath_maxatt;
 
-  for(i=0;i<n;i++)
+  i=0;
+#ifdef VORBIS_SIMD
+  {
+    vorbis_v4f a=v4f_set1(att);
+    for(;i+4<=n;i+=4)
+      v4f_store(logmask+i,v4f_add(v4f_load(p->ath+i),a));
+  }
+#endif
+  for(;i<n;i++)
     logmask[i]=p->ath[i]+att;
 
   /* tone masking */
-  seed_loop(p,(const float ***)p->tonecurves,logfft,logmask,seed,global_specmax);
+  seed_loop(p,(const float ***)p->tonecurves,logfft,logmask,phased,rowlen,
+            global_specmax);
+
+  for(j=0;j<linesper;j++){
+    const float *row=phased+j*rowlen;
+    for(i=j,k=0;i<lines;i+=linesper,k++)
+      seed[i]=row[k];
+  }
+
   max_seeds(p,seed,logmask);
 
 }
@@ -62,6 +62,9 @@ typedef struct vorbis_info_psy
 	int normal_start;
 	int normal_partition;
 	double normal_thresh;
+
+	/* cheaper masking model for draft encodes, see OV_ECTL_DRAFT_SET */
+	int draft_p;
 } vorbis_info_psy;
 
 typedef struct
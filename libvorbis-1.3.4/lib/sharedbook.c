@@ -421,6 +421,7 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
     }
   }
 
+  vorbis_book_select_decode(c);
   return(0);
  err_out:
   vorbis_book_clear(c);
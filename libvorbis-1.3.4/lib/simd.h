@@ -0,0 +1,95 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2007             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: 4-wide float vector helpers for NEON and SSE builds
+
+ ********************************************************************/
+
+#ifndef _V_SIMD_H_
+#define _V_SIMD_H_
+
+/* Compile time selection only; we never probe the CPU at runtime.
+   NEON is used on arm64 and on armv7 built with -mfpu=neon
+   (LOCAL_ARM_NEON), SSE on x86.  Everything else uses the plain C
+   loops.  All helpers use unaligned loads and stores. */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define VORBIS_SIMD_NEON
+
+typedef float32x4_t vorbis_v4f;
+
+#  define v4f_load(p)      vld1q_f32(p)
+#  define v4f_store(p,v)   vst1q_f32((p),(v))
+#  define v4f_add(a,b)     vaddq_f32((a),(b))
+#  define v4f_sub(a,b)     vsubq_f32((a),(b))
+#  define v4f_mul(a,b)     vmulq_f32((a),(b))
+#  define v4f_set1(x)      vdupq_n_f32(x)
+
+/* a>b ? a : b and a<b ? a : b per lane, same as SSE maxps/minps (and
+   as the usual C idiom) including which operand wins for NaN and
+   signed zero */
+#  define v4f_max(a,b)     vbslq_f32(vcgtq_f32((a),(b)),(a),(b))
+#  define v4f_min(a,b)     vbslq_f32(vcltq_f32((a),(b)),(a),(b))
+
+#  if defined(__aarch64__)
+#    define v4f_div(a,b)   vdivq_f32((a),(b))
+#  else
+/* armv7 NEON has only a reciprocal estimate; divide per lane so results
+   stay identical to the scalar code */
+static inline vorbis_v4f v4f_div(vorbis_v4f a,vorbis_v4f b){
+  float x[4],y[4];
+  vst1q_f32(x,a);
+  vst1q_f32(y,b);
+  x[0]/=y[0];
+  x[1]/=y[1];
+  x[2]/=y[2];
+  x[3]/=y[3];
+  return vld1q_f32(x);
+}
+#  endif
+
+/* {p[0],p[-1],p[-2],p[-3]} */
+static inline vorbis_v4f v4f_load_rev(const float *p){
+  float32x4_t v=vrev64q_f32(vld1q_f32(p-3));
+  return vcombine_f32(vget_high_f32(v),vget_low_f32(v));
+}
+
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1)
+#  include <xmmintrin.h>
+#  define VORBIS_SIMD_SSE
+
+typedef __m128 vorbis_v4f;
+
+#  define v4f_load(p)      _mm_loadu_ps(p)
+#  define v4f_store(p,v)   _mm_storeu_ps((p),(v))
+#  define v4f_add(a,b)     _mm_add_ps((a),(b))
+#  define v4f_sub(a,b)     _mm_sub_ps((a),(b))
+#  define v4f_mul(a,b)     _mm_mul_ps((a),(b))
+#  define v4f_set1(x)      _mm_set1_ps(x)
+#  define v4f_max(a,b)     _mm_max_ps((a),(b))
+#  define v4f_min(a,b)     _mm_min_ps((a),(b))
+#  define v4f_div(a,b)     _mm_div_ps((a),(b))
+
+/* {p[0],p[-1],p[-2],p[-3]} */
+static inline vorbis_v4f v4f_load_rev(const float *p){
+  __m128 v=_mm_loadu_ps(p-3);
+  return _mm_shuffle_ps(v,v,_MM_SHUFFLE(0,1,2,3));
+}
+
+#endif
+
+#if defined(VORBIS_SIMD_NEON) || defined(VORBIS_SIMD_SSE)
+#  define VORBIS_SIMD
+#endif
+
+#endif
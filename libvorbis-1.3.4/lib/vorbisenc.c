@@ -320,6 +320,7 @@ static void vorbis_encode_psyset_setup(vorbis_info *vi,double s,
 
   memcpy(p,&_psy_info_template,sizeof(*p));
   p->blockflag=block>>1;
+  p->draft_p=hi->draft_p;
 
   if(hi->noise_normalize_p){
     p->normal_p=1;
@@ -1208,6 +1209,18 @@ int vorbis_encode_ctl(vorbis_info *vi,int number,void *arg){
         vorbis_encode_setup_setting(vi,vi->channels,vi->rate);
       }
       return(0);
+    case OV_ECTL_DRAFT_GET:
+      {
+        int *iarg=(int *)arg;
+        *iarg=hi->draft_p;
+      }
+      return(0);
+    case OV_ECTL_DRAFT_SET:
+      {
+        int *iarg=(int *)arg;
+        hi->draft_p=((*iarg)!=0);
+      }
+      return(0);
     }
     return(OV_EIMPL);
   }
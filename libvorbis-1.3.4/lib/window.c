@@ -16,10 +16,12 @@
  ********************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "os.h"
 #include "misc.h"
 #include "window.h"
+#include "simd.h"
 
 static const float vwin64[32] = {
   0.0009460463F, 0.0085006468F, 0.0235352254F, 0.0458950567F,
@@ -2100,6 +2102,46 @@ const float *_vorbis_window_get(int n){
   return vwin[n];
 }
 
+/* d[i]*=w[i] */
+static void _window_mul(float *d,const float *w,long n){
+  long i=0;
+#ifdef VORBIS_SIMD
+  for(;i+4<=n;i+=4)
+    v4f_store(d+i,v4f_mul(v4f_load(d+i),v4f_load(w+i)));
+#endif
+  for(;i<n;i++)
+    d[i]*=w[i];
+}
+
+/* d[i]*=w[-i]; the window is walked backwards from w */
+static void _window_mul_rev(float *d,const float *w,long n){
+  long i=0;
+#ifdef VORBIS_SIMD
+  for(;i+4<=n;i+=4)
+    v4f_store(d+i,v4f_mul(v4f_load(d+i),v4f_load_rev(w-i)));
+#endif
+  for(;i<n;i++)
+    d[i]*=w[-i];
+}
+
+/* pcm[i]=pcm[i]*w[n-i-1]+p[i]*w[i]; the lapping half of
+   vorbis_synthesis_blockin for any of the long/short transitions.
+   Only the slice of pcm and p differs per transition, the window is
+   always the full n long half of the smaller block */
+void _vorbis_window_overlap_add(float *pcm,const float *p,
+                                const float *w,long n){
+  long i=0;
+#ifdef VORBIS_SIMD
+  for(;i+4<=n;i+=4){
+    vorbis_v4f a=v4f_mul(v4f_load(pcm+i),v4f_load_rev(w+n-i-1));
+    vorbis_v4f b=v4f_mul(v4f_load(p+i),v4f_load(w+i));
+    v4f_store(pcm+i,v4f_add(a,b));
+  }
+#endif
+  for(;i<n;i++)
+    pcm[i]=pcm[i]*w[n-i-1] + p[i]*w[i];
+}
+
 void _vorbis_apply_window(float *d,int *winno,long *blocksizes,
                           int lW,int W,int nW){
   lW=(W?lW:0);
@@ -2119,18 +2161,9 @@ void _vorbis_apply_window(float *d,int *winno,long *blocksizes,
     long rightbegin=n/2+n/4-rn/4;
     long rightend=rightbegin+rn/2;
 
-    int i,p;
-
-    for(i=0;i<leftbegin;i++)
-      d[i]=0.f;
-
-    for(p=0;i<leftend;i++,p++)
-      d[i]*=windowLW[p];
-
-    for(i=rightbegin,p=rn/2-1;i<rightend;i++,p--)
-      d[i]*=windowNW[p];
-
-    for(;i<n;i++)
-      d[i]=0.f;
+    memset(d,0,leftbegin*sizeof(*d));
+    _window_mul(d+leftbegin,windowLW,leftend-leftbegin);
+    _window_mul_rev(d+rightbegin,windowNW+rn/2-1,rightend-rightbegin);
+    memset(d+rightend,0,(n-rightend)*sizeof(*d));
   }
 }
@@ -8,8 +8,14 @@ LOCAL_MODULE_FILENAME := libkoala_sound
 LOCAL_SRC_FILES :=\
 ../src/OpenSL_ES/SoundPool.cpp \
 ../src/OpenSL_ES/OpenSLEngine.cpp\
+../src/OpenSL_ES/LatencyStats.cpp\
 ../src/decoders/OggDecoder.cpp\
+../src/decoders/VorbisSetupCache.cpp\
+../src/decoders/OggStream.cpp\
+../src/decoders/ImaAdpcm.cpp\
+../src/decoders/ChannelMix.cpp\
 ../src/Log.cpp\
+../src/Trace.cpp\
 
 # libogg
 LOCAL_SRC_FILES += \
@@ -58,6 +64,11 @@ LOCAL_LDLIBS    += -lOpenSLES
 # for logging
 LOCAL_LDLIBS    += -llog
 
+# for play() latency measurement, see SoundPool::getLatencyStats()
+#LOCAL_CFLAGS += -DKOALA_LATENCY_STATS
+# KTRACE categories, default is all in DEBUG builds, see Trace.h
+#LOCAL_CFLAGS += -DKOALA_TRACE_CATEGORIES=TRACE_CALLBACK
+
 #LOCAL_CFLAGS += -Wno-psabi -MMD -Wall -fPIC -Wno-unused-function -Wno-unused-result
 #LOCAL_EXPORT_CFLAGS += -Wno-psabi -Wuninitialized -MMD -Wall -Werror -fPIC -std=c++11 -Wno-unused-function -Wno-unused-result
 
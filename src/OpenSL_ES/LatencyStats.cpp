@@ -0,0 +1,213 @@
+/*
+ * LatencyStats.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "LatencyStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace KoalaSound
+{
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+void LatencyHistogram::add( long long microseconds )
+{
+	microseconds = std::max( microseconds, 0LL );
+	int bin = 0;
+
+	//Count of bits is log2 rounded up, it is our bin
+	for( long long value = microseconds; value > 0 && bin < BINS - 1; value >>= 1 )
+	{
+		++bin;
+	}
+
+	m_bins[bin].fetch_add( 1, std::memory_order_relaxed );
+	m_count.fetch_add( 1, std::memory_order_relaxed );
+	m_sumMicroseconds.fetch_add( microseconds, std::memory_order_relaxed );
+
+	long long max = m_maxMicroseconds.load( std::memory_order_relaxed );
+
+	while( microseconds > max && m_maxMicroseconds.compare_exchange_weak( max, microseconds,
+			std::memory_order_relaxed ) == false )
+	{
+	}
+}
+
+void LatencyHistogram::reset()
+{
+	for( auto && bin : m_bins )
+	{
+		bin.store( 0, std::memory_order_relaxed );
+	}
+
+	m_count.store( 0, std::memory_order_relaxed );
+	m_sumMicroseconds.store( 0, std::memory_order_relaxed );
+	m_maxMicroseconds.store( 0, std::memory_order_relaxed );
+}
+
+unsigned LatencyHistogram::getCount() const
+{
+	return m_count.load( std::memory_order_relaxed );
+}
+
+long long LatencyHistogram::getMeanMicroseconds() const
+{
+	const unsigned count = getCount();
+	return count > 0 ? m_sumMicroseconds.load( std::memory_order_relaxed ) / count : 0;
+}
+
+long long LatencyHistogram::getMaxMicroseconds() const
+{
+	return m_maxMicroseconds.load( std::memory_order_relaxed );
+}
+
+long long LatencyHistogram::getPercentileMicroseconds( int percent ) const
+{
+	//Bins are added to while we read, count them instead of trusting m_count
+	unsigned total = 0;
+
+	for( auto && bin : m_bins )
+	{
+		total += bin.load( std::memory_order_relaxed );
+	}
+
+	const unsigned long long wanted = ( static_cast<unsigned long long>( total ) * percent + 99 ) / 100;
+	unsigned long long counted = 0;
+
+	for( int i = 0; i < BINS && total > 0; ++i )
+	{
+		counted += m_bins[i].load( std::memory_order_relaxed );
+
+		if( counted >= wanted )
+		{
+			//Bin bound can be above anything we measured
+			return i < BINS - 1 ? std::min( 1LL << i, getMaxMicroseconds() ) : getMaxMicroseconds();
+		}
+	}
+
+	return 0;
+}
+
+void LatencyHistogram::appendJson( std::string& json ) const
+{
+	char text[160];
+	snprintf( text, sizeof( text ), "{\"count\":%u,\"meanUs\":%lld,\"maxUs\":%lld,\"p50Us\":%lld,\"p90Us\":%lld,"
+			  "\"p99Us\":%lld,\"bins\":[", getCount(), getMeanMicroseconds(), getMaxMicroseconds(),
+			  getPercentileMicroseconds( 50 ), getPercentileMicroseconds( 90 ), getPercentileMicroseconds( 99 ) );
+	json += text;
+
+	//Only bins with something in them, as [upper bound in us, count]. Last bin has no upper bound.
+	bool isFirst = true;
+
+	for( int i = 0; i < BINS; ++i )
+	{
+		const unsigned count = m_bins[i].load( std::memory_order_relaxed );
+
+		if( count == 0 )
+		{
+			continue;
+		}
+
+		snprintf( text, sizeof( text ), "%s[%lld,%u]", isFirst ? "" : ",", i < BINS - 1 ? 1LL << i : -1LL, count );
+		json += text;
+		isFirst = false;
+	}
+
+	json += "]}";
+}
+
+LatencyStats::LatencyStats() :
+	m_sampleRate( 44100 )
+	, m_recentPosition( 0 )
+{
+	m_recentPlays.reserve( RECENT_PLAYS );
+}
+
+bool LatencyStats::isEnabled()
+{
+#ifdef KOALA_LATENCY_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+long long LatencyStats::now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+std::vector<LatencyStats::PlayTiming> LatencyStats::getRecentPlays() const
+{
+	if( static_cast<int>( m_recentPlays.size() ) < RECENT_PLAYS )
+	{
+		return m_recentPlays;
+	}
+
+	//Full ring, oldest is where next one would be written
+	std::vector<PlayTiming> plays( m_recentPlays.begin() + m_recentPosition, m_recentPlays.end() );
+	plays.insert( plays.end(), m_recentPlays.begin(), m_recentPlays.begin() + m_recentPosition );
+	return plays;
+}
+
+void LatencyStats::addRecentPlay( const PlayTiming& timing )
+{
+	if( static_cast<int>( m_recentPlays.size() ) < RECENT_PLAYS )
+	{
+		m_recentPlays.push_back( timing );
+		return;
+	}
+
+	m_recentPlays[m_recentPosition] = timing;
+	m_recentPosition = ( m_recentPosition + 1 ) % RECENT_PLAYS;
+}
+
+void LatencyStats::reset()
+{
+	playToEnqueue.reset();
+	playToCallback.reset();
+	callbackJitter.reset();
+	m_recentPlays.clear();
+	m_recentPosition = 0;
+}
+
+std::string LatencyStats::toJson() const
+{
+	std::string json = isEnabled() ? "{\"enabled\":true" : "{\"enabled\":false";
+	json += ",\"sampleRate\":" + std::to_string( m_sampleRate );
+
+	json += ",\"playToEnqueue\":";
+	playToEnqueue.appendJson( json );
+	json += ",\"playToCallback\":";
+	playToCallback.appendJson( json );
+	json += ",\"callbackJitter\":";
+	callbackJitter.appendJson( json );
+
+	json += ",\"recentPlays\":[";
+	char text[160];
+	bool isFirst = true;
+
+	for( const PlayTiming& timing : getRecentPlays() )
+	{
+		snprintf( text, sizeof( text ), "%s{\"soundId\":%d,\"enqueueUs\":%d,\"firstCallbackUs\":%d,"
+				  "\"firstBufferFrames\":%d}", isFirst ? "" : ",", timing.soundId, timing.enqueueMicroseconds,
+				  timing.firstCallbackMicroseconds, timing.firstBufferFrames );
+		json += text;
+		isFirst = false;
+	}
+
+	json += "]}";
+	return json;
+}
+
+} /* namespace KoalaSound */
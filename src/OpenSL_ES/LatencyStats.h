@@ -0,0 +1,142 @@
+/*
+ * LatencyStats.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef LATENCYSTATS_H_
+#define LATENCYSTATS_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/**
+ * Measuring code is compiled only with KOALA_LATENCY_STATS, like KLOG only with DEBUG. Classes below are
+ * always there, so SoundPool looks the same to code built with and without it.
+ */
+#ifdef KOALA_LATENCY_STATS
+#define KLATENCY( ... ) __VA_ARGS__
+#else
+#define KLATENCY( ... )
+#endif
+
+namespace KoalaSound
+{
+
+/**
+ * Histogram of durations which any thread can add to without locks. Bin 0 counts durations shorter than
+ * 1 us, bin i durations from 2^(i-1) us up to 2^i us, last bin everything longer.
+ */
+class LatencyHistogram
+{
+public:
+	static const int BINS = 24;
+
+	LatencyHistogram();
+
+	//We want block them
+	LatencyHistogram( LatencyHistogram const& ) = delete;
+	void operator= ( LatencyHistogram const& ) = delete;
+
+	void add( long long microseconds );
+	void reset();
+
+	unsigned getCount() const;
+	long long getMeanMicroseconds() const;
+	long long getMaxMicroseconds() const;
+
+	/**
+	 * @param percent e.g. 99
+	 * @return upper bound of bin where given percent of durations is reached (at most maximum), 0 if histogram
+	 * 			is empty
+	 */
+	long long getPercentileMicroseconds( int percent ) const;
+
+	void appendJson( std::string& json ) const;
+
+private:
+	std::atomic<unsigned> m_bins[BINS];
+	std::atomic<unsigned> m_count;
+	std::atomic<long long> m_sumMicroseconds;
+	std::atomic<long long> m_maxMicroseconds;
+};
+
+/**
+ * Where time of SoundPool::play() goes until sound is heard:
+ *  - playToEnqueue: play() itself, voice scan, decode on cache miss, Clear and Enqueue
+ *  - playToCallback: until first buffer finished playing. It includes OpenSL output latency and length
+ *    of first buffer (see PlayTiming::firstBufferFrames), so sound became audible one buffer earlier.
+ *  - callbackJitter: how much time between callbacks differs from length of buffer which finished
+ *
+ * Batched plays are measured from SoundPool::endBatch().
+ */
+class LatencyStats
+{
+public:
+	static const int RECENT_PLAYS = 32;
+
+	struct PlayTiming
+	{
+		int soundId;
+		int enqueueMicroseconds;
+		int firstCallbackMicroseconds;
+		int firstBufferFrames;
+	};
+
+	LatencyStats();
+
+	//We want block them
+	LatencyStats( LatencyStats const& ) = delete;
+	void operator= ( LatencyStats const& ) = delete;
+
+	/**
+	 * @return true if library was built with KOALA_LATENCY_STATS, otherwise nothing is measured
+	 */
+	static bool isEnabled();
+
+	/**
+	 * @return microseconds of steady clock, timestamps of measured calls
+	 */
+	static long long now();
+
+	LatencyHistogram playToEnqueue;
+	LatencyHistogram playToCallback;
+	LatencyHistogram callbackJitter;
+
+	/**
+	 * Last RECENT_PLAYS plays which reached first callback, oldest first
+	 */
+	std::vector<PlayTiming> getRecentPlays() const;
+	void addRecentPlay( const PlayTiming& timing );
+
+	inline int getSampleRate() const
+	{
+		return m_sampleRate;
+	}
+
+	inline void setSampleRate( int sampleRate )
+	{
+		m_sampleRate = sampleRate;
+	}
+
+	void reset();
+
+	/**
+	 * @return all histograms and recent plays as JSON object
+	 */
+	std::string toJson() const;
+
+private:
+	int m_sampleRate;
+	/**
+	 * Ring of recent plays, m_recentPosition is where next one is written
+	 */
+	std::vector<PlayTiming> m_recentPlays;
+	int m_recentPosition;
+};
+
+} /* namespace KoalaSound */
+
+#endif /* LATENCYSTATS_H_ */
@@ -13,14 +13,62 @@
 #include <string.h>
 #include <vector>
 #include <climits>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
 
 #include "Log.h"
+#include "Trace.h"
+#include "decoders/ChannelMix.h"
 
 #define MIN_VOLUME_MILLIBEL -500
 
+/**
+ * Count of buffers in OpenSL buffer queue of each player. We keep it full so there is always next
+ * buffer waiting when one ends.
+ */
+#define BUFFER_QUEUE_SIZE 2
+
+/**
+ * Long sounds are enqueued in chunks of this size. Chunks don't copy data, they point to resource.
+ */
+#define CHUNK_SIZE_BYTES ( 32 * 1024 )
+
+/**
+ * Default limit of decoded PCM kept for loadCompressed() sounds. ~95 s of 44.1kHz mono.
+ */
+#define DEFAULT_DECODED_BUDGET_BYTES ( 8 * 1024 * 1024 )
+
+/**
+ * Streamed sounds are decoded in chunks of this many frames, one chunk per queued buffer. ~93 ms at 44.1kHz.
+ */
+#define STREAM_CHUNK_FRAMES 4096
+
+/**
+ * ADPCM sounds are decoded in chunks of this many frames. Like for resident PCM last chunk can be up to 1.5x longer.
+ */
+#define ADPCM_CHUNK_FRAMES 4096
+
+#define DEFAULT_MAX_STREAMED_VOICES 4
+
+/**
+ * Limit of SetVolumeLevel calls in one SoundPool::update(). Each of them is a call into audio server.
+ */
+#define MAX_VOLUME_CALLS_PER_UPDATE 8
+
+/**
+ * Ramp sets new level only after it moved this much (0.1 dB), slow ramps don't call OpenSL every frame.
+ */
+#define VOLUME_RAMP_STEP_MILLIBEL 10
+
+/**
+ * Looped sounds without player which we remember. When there are more of them lowest priority is forgotten.
+ */
+#define MAX_VIRTUAL_VOICES 32
+
 #define SIZE( array ) (sizeof(array)/sizeof(array[0]))
 
 namespace KoalaSound
@@ -35,7 +83,16 @@ SoundPool::SoundPool( OpenSLEngine* pSLEngine ) :
 	, m_outputMixObject( nullptr )
 	, m_minVolume( MIN_VOLUME_MILLIBEL )
 	, m_maxVolume( 0 )
+	, m_decodedBudget( DEFAULT_DECODED_BUDGET_BYTES )
+	, m_maxStreamedVoices( DEFAULT_MAX_STREAMED_VOICES )
+	, m_updatePosition( 0 )
+	, m_isBatching( false )
+	, m_isBatchStopAll( false )
+	, m_batchMerged( 0 )
+	, m_batchId( 0 )
+	, m_batchCounter( 0 )
 {
+	m_virtualVoices.reserve( MAX_VIRTUAL_VOICES );
 }
 
 SoundPool::~SoundPool()
@@ -43,9 +100,12 @@ SoundPool::~SoundPool()
 	unloadStreams();
 
 	unloadResources();
+
+	//Callback threads of our players are gone, their rings would stay taken for good
+	Trace::reset();
 }
 
-bool SoundPool::init( int maxStreams, SLuint32 samplingRate, SLuint32 bitrate )
+bool SoundPool::init( int maxStreams, SLuint32 samplingRate, SLuint32 bitrate, int stereoStreams )
 {
 	KLOG( "Initializing SoundPool" );
 
@@ -72,6 +132,7 @@ bool SoundPool::init( int maxStreams, SLuint32 samplingRate, SLuint32 bitrate )
 
 	m_samplingRate = samplingRate;
 	m_bitrate = bitrate;
+	m_latencyStats.setSampleRate( samplingRate / 1000 );
 
 	// see if OpenSL library is available
 	void* handle = dlopen( "libOpenSLES.so", RTLD_LAZY );
@@ -85,7 +146,8 @@ bool SoundPool::init( int maxStreams, SLuint32 samplingRate, SLuint32 bitrate )
 	KLOG( "OpenSLES available" );
 	KLOG( "Initializing OpenSLEngine" );
 
-	SLresult result = initializeBufferQueueAudioPlayer( maxStreams );
+	stereoStreams = std::min( std::max( stereoStreams, 0 ), maxStreams );
+	SLresult result = initializeBufferQueueAudioPlayer( maxStreams, stereoStreams );
 
 	if( result != SL_RESULT_SUCCESS )
 	{
@@ -105,6 +167,11 @@ bool SoundPool::init( int maxStreams, SLuint32 samplingRate, SLuint32 bitrate )
 
 void SoundPool::unloadStreams()
 {
+	for( auto && pElement : m_samples )
+	{
+		pElement->instances.clear();
+	}
+
 	for( auto && pElement : m_bufferQueues )
 	{
 		delete pElement;
@@ -121,6 +188,9 @@ void SoundPool::unloadResources()
 	}
 
 	m_samples.clear();
+	m_decodedLru.clear();
+	m_virtualVoices.clear();
+	m_decodeStats.residentBytes = 0;
 }
 
 void SoundPool::play( const Sound& sound, float volume, bool isLooped, int priority )
@@ -133,20 +203,69 @@ void SoundPool::play( const Sound& sound, float volume, bool isLooped, int prior
 	}
 
 	assert( volume >= 0 && volume <= 1 );
+
+	if( m_isBatching )
+	{
+		addBatchedPlay( sound, volume, isLooped, priority );
+		return;
+	}
+
+	startSound( sound, volume, isLooped, priority );
+}
+
+void SoundPool::startSound( const Sound& sound, float volume, bool isLooped, int priority,
+							const VirtualVoice* pResumed )
+{
+	//Check our sample
+	ResourceBuffer* pResource = getResource( sound );
+
+	if( pResource == nullptr )
+	{
+		KLOG( "No such sample: %d", sound.id );
+		return;
+	}
+
+	KTRACE( PLAY_REQUEST, sound.id, priority, static_cast<int>( volume * 1000 ) );
+
+	//Before decoding, rejected play costs nothing
+	const auto now = std::chrono::steady_clock::now();
+	BufferQueue* pInstance = nullptr;
+
+	if( checkLimits( sound, pResource, priority, now, pResumed != nullptr, pInstance ) == false )
+	{
+		return;
+	}
+
 	//I use here specially this name because i don't want make mistake with sampleId (streamId)
 	int positionOfStream = 0;
-	KLOG( "Play sample id: %i at volume %f -> position %d with priority %d", sound.id, volume,
-		  sound.position, priority );
 
 	// find first available buffer queue
 	BufferQueue* pAvailableBuffer = nullptr;
 	BufferQueue* pLowestPriority = nullptr;
 
-	for( positionOfStream = 0; positionOfStream < static_cast<int>( m_bufferQueues.size() );
-			++positionOfStream )
+	if( pInstance != nullptr )
+	{
+		//Sound has all instances it may have, one of them is replaced
+		KTRACE( PLAY_REUSE_INSTANCE, sound.id, pInstance->priority );
+		pAvailableBuffer = pInstance;
+	}
+
+	for( positionOfStream = 0; pAvailableBuffer == nullptr &&
+			positionOfStream < static_cast<int>( m_bufferQueues.size() ); ++positionOfStream )
 	{
-		KLOG( "Checking %d it has %d  and playing %d", positionOfStream,
-			  m_bufferQueues[positionOfStream]->priority, m_bufferQueues[positionOfStream]->playingSoundId );
+		if( m_bufferQueues[positionOfStream]->channels != pResource->channels )
+		{
+			continue;
+		}
+
+		//Sound started by current batch is never stolen by the same batch
+		if( m_batchId != 0 && m_bufferQueues[positionOfStream]->batchId == m_batchId )
+		{
+			continue;
+		}
+
+		KTRACE( PLAY_CHECK_VOICE, positionOfStream, m_bufferQueues[positionOfStream]->priority,
+				m_bufferQueues[positionOfStream]->playingSoundId );
 
 		if( m_bufferQueues[positionOfStream]->playingSoundId == 0 )
 		{
@@ -156,325 +275,1351 @@ void SoundPool::play( const Sound& sound, float volume, bool isLooped, int prior
 		else if( pLowestPriority == nullptr ||
 				 pLowestPriority->priority > m_bufferQueues[positionOfStream]->priority )
 		{
-			KLOG( "Lowest priority: %d", m_bufferQueues[positionOfStream]->priority );
 			pLowestPriority = m_bufferQueues[positionOfStream];
 		}
 	}
 
-	if( pAvailableBuffer == nullptr )
+	const bool isStealing = pAvailableBuffer == nullptr && pLowestPriority != nullptr &&
+							pLowestPriority->priority <= priority;
+
+	if( pAvailableBuffer == nullptr && isStealing == false )
 	{
-		if( pLowestPriority != nullptr && pLowestPriority->priority <= priority )
+		KTRACE( PLAY_NO_VOICE, sound.id, priority );
+		++m_voiceStats.noVoice;
+
+		if( isLooped )
 		{
-			KLOG( "Stoping sound with lower priority id:%d  priority:%d", pLowestPriority->playingSoundId,
-				  pLowestPriority->priority );
-			pLowestPriority->playingSoundId = 0;
-			pLowestPriority->priority = INT_MIN;
-			pLowestPriority->isLooped = false;
+			//It plays later, from where it would be then
+			VirtualVoice voice = pResumed != nullptr ? *pResumed : VirtualVoice( sound, volume, priority, now );
+			voice.channels = pResource->channels;
+			addVirtualVoice( voice );
+		}
+
+		return;
+	}
 
-			pAvailableBuffer = pLowestPriority;
+	//Only play which got voice decodes, so play without voice doesn't stall caller nor evict other sounds
+	bool isStreamed = false;
+
+	if( pResource->pEncoded != nullptr && pResource->isResident() )
+	{
+		++m_decodeStats.hits;
+		makeResident( pResource );
+	}
+	else if( pResource->isStreamed && getStreamedVoicesCount() < m_maxStreamedVoices )
+	{
+		++m_decodeStats.streamedPlays;
+		isStreamed = true;
+	}
+	else if( pResource->pEncoded != nullptr )
+	{
+		if( pResource->isStreamed )
+		{
+			KTRACE( DECODE_STREAM_FALLBACK, sound.id );
+			++m_decodeStats.streamFallbacks;
 		}
-		else
+
+		//Caller waits for whole decode, prefetch() would have avoided it
+		++m_decodeStats.misses;
+		const auto start = std::chrono::steady_clock::now();
+
+		if( makeResident( pResource ) == false )
 		{
-			KLOG( "No channels available for playback" );
 			return;
 		}
-	}
 
-	KLOG( "Playing on channel %d", positionOfStream );
+		const long long stall = std::chrono::duration_cast<std::chrono::microseconds>(
+									std::chrono::steady_clock::now() - start ).count();
+		m_decodeStats.stallMicroseconds += stall;
+		m_decodeStats.maxStallMicroseconds = std::max( m_decodeStats.maxStallMicroseconds, stall );
+		KTRACE( DECODE_MISS, sound.id, static_cast<int>( stall ) );
+	}
 
-	//Check our sample
-	if( sound.position > static_cast<int>( m_samples.size() ) ||
-			m_samples[sound.position] == nullptr )
+	//Voice was chosen by channels read at load, decode tells real ones. They differ only for broken stream.
+	if( ( isStealing ? pLowestPriority : pAvailableBuffer )->channels != pResource->channels )
 	{
-		KLOG( "No such sample: %d", sound.id );
+		KLOG( "Sound %d has other channels count than it had when loaded", sound.id );
 		return;
 	}
 
-	ResourceBuffer* pResource = m_samples[sound.position];
+	if( isStealing )
+	{
+		KTRACE( PLAY_STEAL, pLowestPriority->playingSoundId, pLowestPriority->priority, priority );
+		++m_voiceStats.stolenByPriority;
+
+		if( pLowestPriority->isLooped )
+		{
+			const Sound stolen( pLowestPriority->playingSoundId, pLowestPriority->soundPosition );
+			addVirtualVoice( VirtualVoice( stolen, pLowestPriority, now ) );
+		}
+
+		pAvailableBuffer = pLowestPriority;
+	}
+
 
+	//Callback of sound which played on voice may run just now, after this it leaves voice to us
+	pAvailableBuffer->acquire();
 	SLresult result;
 
 	// convert requested volume 0.0-1.0 to millibels
-	SLmillibel newVolume = int ( ( m_maxVolume - m_minVolume ) * volume ) + m_minVolume;
+	SLmillibel newVolume = toMillibel( volume );
 
-	KLOG( "Seting volume: %d", newVolume );
+	KTRACE( PLAY_START, sound.id, static_cast<int>( std::find( m_bufferQueues.begin(), m_bufferQueues.end(),
+			pAvailableBuffer ) - m_bufferQueues.begin() ), newVolume );
 	//adjust volume for the buffer queue
-	result = ( *pAvailableBuffer->volume )->SetVolumeLevel( pAvailableBuffer->volume, newVolume );
+	result = pAvailableBuffer->setVolumeLevel( newVolume );
 
 	if( result != SL_RESULT_SUCCESS )
 	{
 		KLOG( "Error:%d -> %s", ( int ) result, getErrorMessage( result ) );
 		assert( result == SL_RESULT_SUCCESS );
+		pAvailableBuffer->stop();
+		pAvailableBuffer->release();
 		return;
 	}
 
-	result = ( * ( pAvailableBuffer->queue ) )->Clear( pAvailableBuffer->queue );
-	assert( SL_RESULT_SUCCESS == result );
+	pAvailableBuffer->isRamping = false;
+	pAvailableBuffer->rampTo = volume;
+
+	//Player could be panned by previous sound
+	result = pAvailableBuffer->setStereoPosition( pResumed != nullptr ? pResumed->stereoPosition : 0 );
+	assert( result == SL_RESULT_SUCCESS );
+
+	//Sound which was virtual continues from where it would be if it kept playing
+	const auto startTime = pResumed != nullptr ? pResumed->startTime : now;
+	const long long startFrame = std::chrono::duration_cast<std::chrono::microseconds>( now - startTime ).count() *
+								 ( m_samplingRate / 1000 ) / 1000000;
 
-	//enqueue the sound
-	result = ( *pAvailableBuffer->queue )->Enqueue( pAvailableBuffer->queue,
-			 static_cast<void*>( pResource->pBuffer ), pResource->size );
+	//Set before buffers are enqueued, short sound may complete in first callback after release()
+	pAvailableBuffer->playingSoundId = sound.id;
+	pAvailableBuffer->soundPosition = sound.position;
+	pAvailableBuffer->priority = priority;
+	pAvailableBuffer->batchId = m_batchId;
+	pAvailableBuffer->startTime = startTime;
+
+	result = pAvailableBuffer->start( pResource, isLooped, isStreamed, startFrame );
 
 	if( result != SL_RESULT_SUCCESS )
 	{
 		KLOG( "Error:%d -> %s", ( int ) result, getErrorMessage( result ) );
 		assert( result == SL_RESULT_SUCCESS );
+		pAvailableBuffer->stop();
+		pAvailableBuffer->release();
 		return;
 	}
 
-	result = ( * ( pAvailableBuffer->playerPlay ) )->SetPlayState( pAvailableBuffer->playerPlay,
-			 SL_PLAYSTATE_PLAYING );
+	KLATENCY( pAvailableBuffer->measurePlay( now ) );
+	pAvailableBuffer->release();
+
+	//Player was stopped while we enqueued, first callback of new sound comes after this
+	result = pAvailableBuffer->setPlayState( SL_PLAYSTATE_PLAYING );
 	assert( SL_RESULT_SUCCESS == result );
 
-	pAvailableBuffer->playingSoundId = sound.id;
-	pAvailableBuffer->priority = priority;
-	pAvailableBuffer->isLooped = isLooped;
-	pAvailableBuffer->pLastBuffer = pResource->pBuffer;
-	pAvailableBuffer->lastSize = pResource->size;
-}
+	++m_voiceStats.plays;
+	pResource->lastPlayTime = now;
+	pResource->hasPlayed = true;
 
-Sound SoundPool::load( char* pBuffer, int length )
-{
-	ResourceBuffer* pResource = new ResourceBuffer();
-	pResource->pBuffer = pBuffer;
-	pResource->size = length;
-	m_samples.emplace_back( pResource );
+	//Reused instance is already there, so is instance of this sound stolen by priority. Capacity is reserved,
+	//no allocation here.
+	std::vector<BufferQueue*>& instances = pResource->instances;
 
-	if( m_idGenerator == -1 )
+	if( pResource->maxInstances > 0 && pInstance == nullptr &&
+			std::find( instances.begin(), instances.end(), pAvailableBuffer ) == instances.end() )
 	{
-		//We don't want 0 value it is used for errors
-		++m_idGenerator;
+		instances.push_back( pAvailableBuffer );
 	}
-
-	return Sound( ++m_idGenerator, m_samples.size() - 1 );
 }
 
-void SoundPool::pauseSound( const Sound& sound )
+bool SoundPool::checkLimits( const Sound& sound, ResourceBuffer* pResource, int priority,
+							 std::chrono::steady_clock::time_point now, bool isResumed, BufferQueue*& pInstance )
 {
-	for( auto && pElement : m_bufferQueues )
-	{
-		if( pElement->playingSoundId == sound.id )
-		{
-			SLresult result;
-			result = ( * ( pElement->playerPlay ) )->SetPlayState( pElement->playerPlay, SL_PLAYSTATE_PAUSED );
-			KLOG( "Pause sound on buffer position: %d   id:%d", sound.position, sound.id );
-			assert( SL_RESULT_SUCCESS == result );
-		}
-	}
-}
+	pInstance = nullptr;
 
-void SoundPool::resumeSound( const Sound& sound )
-{
-	for( auto && pElement : m_bufferQueues )
+	if( isResumed == false && pResource->hasPlayed && pResource->minRetriggerMilliseconds > 0 &&
+			now - pResource->lastPlayTime < std::chrono::milliseconds( pResource->minRetriggerMilliseconds ) )
 	{
-		if( pElement->playingSoundId == sound.id )
-		{
-			SLresult result;
-			result = ( * ( pElement->playerPlay ) )->SetPlayState( pElement->playerPlay,
-					 SL_PLAYSTATE_PLAYING );
-			KLOG( "Resume sound on buffer position: %d   id:%d", sound.position, sound.id );
-			assert( SL_RESULT_SUCCESS == result );
-		}
+		KTRACE( PLAY_REJECT_RETRIGGER, sound.id );
+		++m_voiceStats.rejectedRetrigger;
+		return false;
 	}
-}
 
-void SoundPool::stopSound( const Sound& sound )
-{
-	for( auto && pElement : m_bufferQueues )
+	if( pResource->maxInstances < 1 )
 	{
-		if( pElement->playingSoundId == sound.id )
-		{
-			SLresult result;
-			result = ( * ( pElement->playerPlay ) )->SetPlayState( pElement->playerPlay,
-					 SL_PLAYSTATE_STOPPED );
-			pElement->playingSoundId = 0;
-			KLOG( "Stoping sound on buffer position: %d   id:%d", sound.position, sound.id );
-			assert( SL_RESULT_SUCCESS == result );
-		}
+		return true;
 	}
-}
 
-void SoundPool::pauseAllSounds()
-{
-	KLOG( "Pause all sounds" );
+	//Forget voices which ended or were taken by other sound. List is never longer than maxInstances.
+	std::vector<BufferQueue*>& instances = pResource->instances;
+	instances.erase( std::remove_if( instances.begin(), instances.end(), [&sound]( const BufferQueue * pElement )
+	{
+		return pElement->playingSoundId != sound.id;
+	} ), instances.end() );
 
-	for( auto && pElement : m_bufferQueues )
+	if( static_cast<int>( instances.size() ) < pResource->maxInstances )
 	{
-		if( pElement->playingSoundId == 0 )
-		{
-			continue;
-		}
+		return true;
+	}
 
-		SLresult result;
-		result = ( * ( pElement->playerPlay ) )->SetPlayState( pElement->playerPlay, SL_PLAYSTATE_PAUSED );
-		assert( SL_RESULT_SUCCESS == result );
+	if( isResumed )
+	{
+		KTRACE( PLAY_REJECT_LIMIT, sound.id, static_cast<int>( instances.size() ) );
+		++m_voiceStats.rejectedLimit;
+		return false;
 	}
-}
 
-void SoundPool::resumeAllSounds()
-{
-	KLOG( "Resume all sounds" );
+	const StealPolicy policy = pResource->stealPolicy;
 
-	for( auto && pElement : m_bufferQueues )
+	for( auto && pElement : instances )
 	{
-		if( pElement->playingSoundId == 0 )
+		//Batch doesn't replace what it started itself
+		if( m_batchId != 0 && pElement->batchId == m_batchId )
 		{
 			continue;
 		}
 
-		SLresult result;
-		result = ( * ( pElement->playerPlay ) )->SetPlayState( pElement->playerPlay,
-				 SL_PLAYSTATE_PLAYING );
-		assert( SL_RESULT_SUCCESS == result );
+		if( pInstance == nullptr ||
+				( policy == StealPolicy::OLDEST && pElement->startTime < pInstance->startTime ) ||
+				( policy == StealPolicy::QUIETEST && pElement->getVolume( now ) < pInstance->getVolume( now ) ) ||
+				( policy == StealPolicy::LOWEST_PRIORITY && pElement->priority < pInstance->priority ) )
+		{
+			pInstance = pElement;
+		}
+	}
+
+	if( pInstance == nullptr || policy == StealPolicy::NONE ||
+			( policy == StealPolicy::LOWEST_PRIORITY && pInstance->priority > priority ) )
+	{
+		KTRACE( PLAY_REJECT_LIMIT, sound.id, static_cast<int>( instances.size() ) );
+		pInstance = nullptr;
+		++m_voiceStats.rejectedLimit;
+		return false;
 	}
-}
 
+	++m_voiceStats.stolenByLimit;
+	return true;
+}
 
-void SoundPool::stopAllSounds()
+void SoundPool::setSoundLimits( const Sound& sound, int maxInstances, int minRetriggerMilliseconds,
+								StealPolicy stealPolicy )
 {
-	KLOG( "Stoping all sounds" );
+	ResourceBuffer* pResource = getResource( sound );
 
-	for( auto && pElement : m_bufferQueues )
+	if( pResource == nullptr )
 	{
-		if( pElement->playingSoundId == 0 )
-		{
-			continue;
-		}
-
-		SLresult result;
-		result = ( * ( pElement->playerPlay ) )->SetPlayState( pElement->playerPlay,
-				 SL_PLAYSTATE_STOPPED );
-		pElement->playingSoundId = 0;
-		assert( SL_RESULT_SUCCESS == result );
+		KLOG( "No such sample: %d", sound.id );
+		assert( false );
+		return;
 	}
+
+	pResource->maxInstances = std::max( maxInstances, 0 );
+	pResource->minRetriggerMilliseconds = std::max( minRetriggerMilliseconds, 0 );
+	pResource->stealPolicy = stealPolicy;
+	pResource->instances.reserve( pResource->maxInstances );
 }
 
-SLresult SoundPool::initializeBufferQueueAudioPlayer( int maxStreams )
+void SoundPool::beginBatch()
 {
-	KLOG( "Initializing BufferQueueAudioPlayer" );
-	SLresult result;
-
-	// configure audio source
-	SLDataLocator_AndroidSimpleBufferQueue loc_bufq = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, 2};
-	SLDataFormat_PCM format_pcm = {SL_DATAFORMAT_PCM, 1, m_samplingRate, m_bitrate, m_bitrate,
-								   SL_SPEAKER_FRONT_CENTER , SL_BYTEORDER_LITTLEENDIAN
-								  };
-
-	SLDataSource audioSource = {&loc_bufq, &format_pcm};
+	assert( m_isBatching == false );
+	m_isBatching = true;
+}
 
-	// create audio player
-	const SLInterfaceID player_ids[] = {SL_IID_BUFFERQUEUE, SL_IID_PLAY, SL_IID_VOLUME};
-	const SLboolean player_req[] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
+void SoundPool::endBatch()
+{
+	assert( m_isBatching );
+	m_isBatching = false;
 
-	static_assert( SIZE( player_ids ) == SIZE( player_req ), "Set on both values" );
+	if( m_isBatchStopAll )
+	{
+		stopAllSounds();
+	}
 
-	KLOG( "Creating %i streams", maxStreams );
+	for( auto && sound : m_batchedStops )
+	{
+		stopSound( sound );
+	}
 
-	for( int i = 0; i < maxStreams; ++i )
+	//Highest priority first, so stealing is decided for whole batch at once. Ties keep order of play() calls.
+	std::stable_sort( m_batchedPlays.begin(), m_batchedPlays.end(),
+					  []( const BatchedPlay & first, const BatchedPlay & second )
 	{
-		BufferQueue* pBufferQueue = new BufferQueue();
+		return first.priority > second.priority;
+	} );
 
-		// configure audio sink
-		SLDataLocator_OutputMix loc_outmix = {SL_DATALOCATOR_OUTPUTMIX, m_pEngine->getOutputMixObject() };
-		SLDataSink audioSnk = {&loc_outmix, NULL};
+	m_batchCounter = m_batchCounter == INT_MAX ? 1 : m_batchCounter + 1;
+	m_batchId = m_batchCounter;
 
-		//SLVolumeItf volume;
-		KLOG( "Creating SLAndroidSimpleBufferQueueItf" );
+	for( auto && batchedPlay : m_batchedPlays )
+	{
+		startSound( batchedPlay.sound, batchedPlay.volume, batchedPlay.isLooped, batchedPlay.priority );
+	}
 
-		result = ( *m_pEngine->getEngine() )->CreateAudioPlayer( m_pEngine->getEngine(),
-				 &pBufferQueue->player, &audioSource, &audioSnk, SIZE( player_ids ), player_ids, player_req );
+	m_batchId = 0;
 
-		if( result != SL_RESULT_SUCCESS )
+	//Now they apply also to sounds started by this batch
+	for( auto && control : m_batchedControls )
+	{
+		if( control.isPan )
 		{
-			delete pBufferQueue;
-			KLOG( "Can't create more players" );
-			break;
+			setPan( control.sound, control.value );
 		}
-
-		result = pBufferQueue->realize();
-
-		if( result != SL_RESULT_SUCCESS )
+		else
 		{
-			delete pBufferQueue;
-			KLOG( "Can't realize player" );
-			break;
+			setVolume( control.sound, control.value, control.rampMilliseconds );
 		}
+	}
 
-		result = ( *pBufferQueue->playerPlay )->SetPlayState( pBufferQueue->playerPlay,
-				 SL_PLAYSTATE_PLAYING );
+	KTRACE( CONTROL_BATCH, static_cast<int>( m_batchedPlays.size() ), m_batchMerged,
+			static_cast<int>( m_batchedStops.size() ) );
 
-		if( result != SL_RESULT_SUCCESS )
+	m_batchedPlays.clear();
+	m_batchedStops.clear();
+	m_batchedControls.clear();
+	m_isBatchStopAll = false;
+	m_batchMerged = 0;
+}
+
+void SoundPool::addBatchedPlay( const Sound& sound, float volume, bool isLooped, int priority )
+{
+	for( auto && batchedPlay : m_batchedPlays )
+	{
+		//The same trigger again in this frame, e.g. many impacts. One voice is enough, just the loudest.
+		if( batchedPlay.sound.id == sound.id && batchedPlay.isLooped == isLooped )
 		{
-			delete pBufferQueue;
-			KLOG( "Can't set player state" );
-			break;
+			batchedPlay.volume = std::max( batchedPlay.volume, volume );
+			batchedPlay.priority = std::max( batchedPlay.priority, priority );
+			++m_batchMerged;
+			return;
 		}
+	}
 
-		m_bufferQueues.push_back( pBufferQueue );
-		KLOG( "Created stream %d", i );
+	m_batchedPlays.push_back( BatchedPlay( sound, volume, isLooped, priority ) );
+}
+
+void SoundPool::removeBatched( int soundId )
+{
+	m_batchedPlays.erase( std::remove_if( m_batchedPlays.begin(), m_batchedPlays.end(),
+										  [soundId]( const BatchedPlay & batchedPlay )
+	{
+		return batchedPlay.sound.id == soundId;
+	} ), m_batchedPlays.end() );
+
+	m_batchedControls.erase( std::remove_if( m_batchedControls.begin(), m_batchedControls.end(),
+							 [soundId]( const BatchedControl & control )
+	{
+		return control.sound.id == soundId;
+	} ), m_batchedControls.end() );
+}
+
+Sound SoundPool::load( char* pBuffer, int length, int loopStart, int loopLength, int channels )
+{
+	if( channels < 1 || channels > 2 )
+	{
+		KLOG( "Only mono and stereo sounds can be played" );
+		assert( false );
+		return Sound::invalidSound();
 	}
 
-	if( m_bufferQueues.empty() )
+	ResourceBuffer* pResource = new ResourceBuffer();
+	pResource->pBuffer = convertToPlayable( pBuffer, length, channels, false );
+	pResource->size = length;
+	pResource->channels = channels;
+	setLoopPoints( pResource, loopStart, loopLength );
+
+	return addResource( pResource );
+}
+
+Sound SoundPool::loadCompressed( char* pBuffer, int length )
+{
+	if( pBuffer == nullptr || length < 4 || memcmp( pBuffer, "OggS", 4 ) != 0 )
 	{
-		return result;
+		KLOG( "This isn't ogg file" );
+		assert( false );
+		return Sound::invalidSound();
 	}
 
-	assert( m_bufferQueues.empty() == false );
-	BufferQueue* pBufferQueue = m_bufferQueues.front();
+	ResourceBuffer* pResource = new ResourceBuffer();
+	pResource->pEncoded = pBuffer;
+	pResource->encodedSize = length;
+	pResource->lruPosition = m_decodedLru.end();
 
-	KLOG( "Getting max volume level" );
-	result = ( *pBufferQueue->volume )->GetMaxVolumeLevel( pBufferQueue->volume, &m_maxVolume );
+	//We need to know where it will play before it is decoded. Decoding sets it again, converted if needed.
+	int bitrate = 0;
 
-	if( result != SL_RESULT_SUCCESS )
+	if( OggDecoder::readFormat( pBuffer, length, pResource->channels, bitrate ) )
 	{
-		return result;
+		pResource->channels = getPlayableChannels( pResource->channels );
 	}
 
-	KLOG( "createBufferQueueAudioPlayer done" );
-	return result;
+	return addResource( pResource );
 }
 
-SLresult BufferQueue::realize()
+Sound SoundPool::loadStreamed( char* pBuffer, int length )
 {
-	SLresult result;
-	// realize the player
-	KLOG( "Realize player" );
-	result = ( *player )->Realize( player, SL_BOOLEAN_FALSE );
+	Sound sound = loadCompressed( pBuffer, length );
+	ResourceBuffer* pResource = getResource( sound );
+
+	int channels = 0;
+	int bitrate = 0;
+
+	if( pResource == nullptr || OggDecoder::readFormat( pBuffer, length, channels, bitrate ) == false )
+	{
+		return sound;
+	}
+
+	//Streamed PCM can't be converted, such sound is decoded whole on every play and converted
+	if( getPlayableChannels( channels ) != channels )
+	{
+		KLOG( "No %d channel players, sound won't be streamed", channels );
+		return sound;
+	}
+
+	pResource->isStreamed = true;
+
+	return sound;
+}
+
+void SoundPool::setMaxStreamedVoices( int count )
+{
+	m_maxStreamedVoices = count;
+}
+
+Sound SoundPool::loadAdpcm( char* pBuffer, int length )
+{
+	ImaAdpcm::Info info;
+
+	if( ImaAdpcm::readInfo( pBuffer, length, info ) == false )
+	{
+		assert( false );
+		return Sound::invalidSound();
+	}
+
+	if( info.rate * 1000 != static_cast<int>( m_samplingRate ) )
+	{
+		KLOG( "Sound is %dHz but pool plays %dHz", info.rate, static_cast<int>( m_samplingRate / 1000 ) );
+	}
+
+	if( getPlayableChannels( info.channels ) != info.channels )
+	{
+		//Conversion needs PCM, it is done once here and ADPCM is dropped
+		KLOG( "No %d channel players, decoding ADPCM sound", info.channels );
+		const int size = info.frames * 2 * info.channels;
+		char* pPcm = static_cast<char*>( malloc( size ) );
+
+		if( pPcm == nullptr )
+		{
+			KLOG( "Can't allocate %d bytes for decoded ADPCM sound", size );
+			return Sound::invalidSound();
+		}
+
+		ImaAdpcm::decode( pBuffer, 0, info.frames, reinterpret_cast<short*>( pPcm ) );
+		free( pBuffer );
+		return load( pPcm, size, info.loopStart, info.loopLength, info.channels );
+	}
+
+	ResourceBuffer* pResource = new ResourceBuffer();
+	pResource->pBuffer = pBuffer;
+	pResource->isAdpcm = true;
+	pResource->channels = info.channels;
+	pResource->size = info.frames * 2 * info.channels;
+	setLoopPoints( pResource, info.loopStart, info.loopLength );
+
+	return addResource( pResource );
+}
+
+void SoundPool::prefetch( const Sound& sound )
+{
+	ResourceBuffer* pResource = getResource( sound );
+
+	if( pResource == nullptr || pResource->pEncoded == nullptr || pResource->isResident() )
+	{
+		return;
+	}
+
+	++m_decodeStats.prefetches;
+	makeResident( pResource );
+}
+
+void SoundPool::setDecodedBudget( size_t bytes )
+{
+	m_decodedBudget = bytes;
+	evictDecoded( 0 );
+}
+
+Sound SoundPool::addResource( ResourceBuffer* pResource )
+{
+	m_samples.emplace_back( pResource );
+
+	if( m_idGenerator == -1 )
+	{
+		//We don't want 0 value it is used for errors
+		++m_idGenerator;
+	}
+
+	return Sound( ++m_idGenerator, m_samples.size() - 1 );
+}
+
+ResourceBuffer* SoundPool::getResource( const Sound& sound )
+{
+	if( sound.id == 0 || sound.position < 0 || sound.position >= static_cast<int>( m_samples.size() ) )
+	{
+		return nullptr;
+	}
+
+	return m_samples[sound.position];
+}
+
+void SoundPool::setLoopPoints( ResourceBuffer* pResource, int loopStart, int loopLength )
+{
+	pResource->loopOffset = 0;
+	pResource->loopSize = pResource->size;
+
+	const int frameSize = m_bitrate / 8 * pResource->channels;
+
+	if( loopLength > 0 && loopStart >= 0 && loopStart * frameSize < pResource->size )
+	{
+		pResource->loopOffset = loopStart * frameSize;
+		pResource->loopSize = std::min( loopLength * frameSize, pResource->size - pResource->loopOffset );
+		KLOG( "Loop body offset: %d size: %d", pResource->loopOffset, pResource->loopSize );
+	}
+}
+
+bool SoundPool::makeResident( ResourceBuffer* pResource )
+{
+	assert( pResource->pEncoded != nullptr );
+
+	if( pResource->isResident() )
+	{
+		m_decodedLru.splice( m_decodedLru.begin(), m_decodedLru, pResource->lruPosition );
+		return true;
+	}
+
+	Data data = m_decoder.decode( pResource->pEncoded, pResource->encodedSize );
+
+	if( data.pData == nullptr )
+	{
+		KLOG( "Can't decode compressed sound" );
+		return false;
+	}
+
+	if( data.bitrate * 1000 != static_cast<int>( m_samplingRate ) )
+	{
+		KLOG( "Sound is %dHz but pool plays %dHz", data.bitrate, static_cast<int>( m_samplingRate / 1000 ) );
+	}
+
+	int size = data.size;
+	int channels = data.channelsCount;
+	char* pPcm = convertToPlayable( data.pData, size, channels, true );
+
+	evictDecoded( size );
+
+	pResource->pBuffer = pPcm;
+	pResource->size = size;
+	pResource->channels = channels;
+	setLoopPoints( pResource, data.loopStart, data.loopLength );
+
+	m_decodedLru.push_front( pResource );
+	pResource->lruPosition = m_decodedLru.begin();
+	m_decodeStats.residentBytes += size;
+	return true;
+}
+
+void SoundPool::evictDecoded( size_t size )
+{
+	auto it = m_decodedLru.end();
+
+	while( m_decodeStats.residentBytes + size > m_decodedBudget && it != m_decodedLru.begin() )
+	{
+		--it;
+		ResourceBuffer* pResource = *it;
+
+		if( isPlaying( pResource ) )
+		{
+			continue;
+		}
+
+		m_decodeStats.residentBytes -= pResource->size;
+		++m_decodeStats.evictions;
+		pResource->releaseDecoded();
+		it = m_decodedLru.erase( it );
+		pResource->lruPosition = m_decodedLru.end();
+	}
+
+	if( m_decodeStats.residentBytes + size > m_decodedBudget )
+	{
+		KLOG( "Decoded sounds over budget, all of them are playing" );
+	}
+}
+
+bool SoundPool::isPlaying( const ResourceBuffer* pResource ) const
+{
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId != 0 && pElement->pBuffer == pResource->pBuffer )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int SoundPool::getStreamedVoicesCount() const
+{
+	int count = 0;
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId != 0 && pElement->isStreaming )
+		{
+			++count;
+		}
+	}
+
+	return count;
+}
+
+int SoundPool::getPlayableChannels( int channels ) const
+{
+	if( channels < 1 || channels > 2 || m_bufferQueues.empty() )
+	{
+		return channels;
+	}
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->channels == channels )
+		{
+			return channels;
+		}
+	}
+
+	//Pool has players, all of them have the other channels count
+	return 3 - channels;
+}
+
+char* SoundPool::convertToPlayable( char* pPcm, int& size, int& channels, bool isNewArray )
+{
+	const int playableChannels = getPlayableChannels( channels );
+
+	if( playableChannels == channels )
+	{
+		return pPcm;
+	}
+
+	KLOG( "No %d channel players, converting sound to %d channels", channels, playableChannels );
+	const int frames = size / ( 2 * channels );
+	const int convertedSize = frames * 2 * playableChannels;
+	char* pConverted = isNewArray ? new char[convertedSize] : static_cast<char*>( malloc( convertedSize ) );
+
+	if( playableChannels == 1 )
+	{
+		ChannelMix::downmix( reinterpret_cast<short*>( pPcm ), frames, reinterpret_cast<short*>( pConverted ) );
+	}
+	else
+	{
+		ChannelMix::upmix( reinterpret_cast<short*>( pPcm ), frames, reinterpret_cast<short*>( pConverted ) );
+	}
+
+	if( isNewArray )
+	{
+		delete[] pPcm;
+	}
+	else
+	{
+		free( pPcm );
+	}
+
+	size = convertedSize;
+	channels = playableChannels;
+	return pConverted;
+}
+
+void SoundPool::setVolume( const Sound& sound, float volume, int rampMilliseconds )
+{
+	assert( volume >= 0 && volume <= 1 );
+	const auto now = std::chrono::steady_clock::now();
+
+	if( sound.id == 0 )
+	{
+		return;
+	}
+
+	if( m_isBatching )
+	{
+		m_batchedControls.push_back( BatchedControl( sound, false, volume, rampMilliseconds ) );
+		return;
+	}
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId != sound.id )
+		{
+			continue;
+		}
+
+		if( rampMilliseconds > 0 )
+		{
+			pElement->rampFrom = pElement->getVolume( now );
+			pElement->rampStart = now;
+			pElement->rampMilliseconds = rampMilliseconds;
+			pElement->isRamping = true;
+		}
+		else
+		{
+			pElement->isRamping = false;
+			SLresult result = pElement->setVolumeLevel( toMillibel( volume ) );
+			assert( SL_RESULT_SUCCESS == result );
+		}
+
+		pElement->rampTo = volume;
+	}
+
+	for( auto && voice : m_virtualVoices )
+	{
+		if( voice.sound.id == sound.id )
+		{
+			voice.volume = volume;
+		}
+	}
+}
+
+void SoundPool::setPan( const Sound& sound, float pan )
+{
+	assert( pan >= -1 && pan <= 1 );
+	const SLpermille position = static_cast<SLpermille>( std::min( std::max( pan, -1.0f ), 1.0f ) * 1000 );
+
+	if( sound.id == 0 )
+	{
+		return;
+	}
+
+	if( m_isBatching )
+	{
+		m_batchedControls.push_back( BatchedControl( sound, true, pan, 0 ) );
+		return;
+	}
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == sound.id )
+		{
+			SLresult result = pElement->setStereoPosition( position );
+			assert( SL_RESULT_SUCCESS == result );
+		}
+	}
+
+	for( auto && voice : m_virtualVoices )
+	{
+		if( voice.sound.id == sound.id )
+		{
+			voice.stereoPosition = position;
+		}
+	}
+}
+
+void SoundPool::update()
+{
+	const int count = m_bufferQueues.size();
+	const auto now = std::chrono::steady_clock::now();
+	int calls = 0;
+	int checked = 0;
+
+	for( ; checked < count && calls < MAX_VOLUME_CALLS_PER_UPDATE; ++checked )
+	{
+		BufferQueue* pElement = m_bufferQueues[( m_updatePosition + checked ) % count];
+
+		if( pElement->isRamping == false )
+		{
+			continue;
+		}
+
+		if( pElement->playingSoundId == 0 )
+		{
+			pElement->isRamping = false;
+			continue;
+		}
+
+		const bool isFinished = now - pElement->rampStart >= std::chrono::milliseconds( pElement->rampMilliseconds );
+		const SLmillibel level = toMillibel( pElement->getVolume( now ) );
+
+		//Last step always lands exactly on target
+		if( isFinished == false && abs( level - pElement->volumeLevel ) < VOLUME_RAMP_STEP_MILLIBEL )
+		{
+			continue;
+		}
+
+		if( level != pElement->volumeLevel )
+		{
+			SLresult result = pElement->setVolumeLevel( level );
+			assert( SL_RESULT_SUCCESS == result );
+			++calls;
+		}
+
+		pElement->isRamping = isFinished == false;
+	}
+
+	//Continue next time where we stopped
+	m_updatePosition = count > 0 ? ( m_updatePosition + checked ) % count : 0;
+
+	if( m_virtualVoices.empty() == false )
+	{
+		resumeVirtualVoices();
+	}
+}
+
+SoundPool::VirtualVoice::VirtualVoice( const Sound& sound, const BufferQueue* pVoice,
+									   std::chrono::steady_clock::time_point now ) :
+	sound( sound )
+	//Volume it was sliding to, fade in continues at new player from there
+	, volume( pVoice->rampTo )
+	, stereoPosition( pVoice->stereoPosition )
+	, priority( pVoice->priority )
+	, channels( pVoice->channels )
+	, startTime( pVoice->startTime )
+	, isPaused( pVoice->playState == SL_PLAYSTATE_PAUSED )
+	, pauseTime( pVoice->playState == SL_PLAYSTATE_PAUSED ? pVoice->pauseTime : now )
+{
+}
+
+void SoundPool::addVirtualVoice( const VirtualVoice& voice )
+{
+	KTRACE( PLAY_VIRTUALIZE, voice.sound.id, voice.priority );
+	++m_voiceStats.virtualized;
+
+	if( m_virtualVoices.size() < MAX_VIRTUAL_VOICES )
+	{
+		m_virtualVoices.push_back( voice );
+		return;
+	}
+
+	auto lowest = std::min_element( m_virtualVoices.begin(), m_virtualVoices.end(),
+									[]( const VirtualVoice & first, const VirtualVoice & second )
+	{
+		return first.priority < second.priority;
+	} );
+
+	++m_voiceStats.virtualDropped;
+
+	if( lowest->priority > voice.priority )
+	{
+		KTRACE( PLAY_VIRTUAL_DROP, voice.sound.id, voice.priority );
+		return;
+	}
+
+	KTRACE( PLAY_VIRTUAL_DROP, lowest->sound.id, lowest->priority );
+	*lowest = voice;
+}
+
+void SoundPool::resumeVirtualVoices()
+{
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId != 0 )
+		{
+			continue;
+		}
+
+		auto highest = m_virtualVoices.end();
+
+		for( auto it = m_virtualVoices.begin(); it != m_virtualVoices.end(); ++it )
+		{
+			if( it->isPaused == false && it->channels == pElement->channels &&
+					( highest == m_virtualVoices.end() || it->priority > highest->priority ) )
+			{
+				highest = it;
+			}
+		}
+
+		if( highest == m_virtualVoices.end() )
+		{
+			continue;
+		}
+
+		//Copy, vector is changed by startSound
+		const VirtualVoice voice = *highest;
+		m_virtualVoices.erase( highest );
+		KTRACE( PLAY_VIRTUAL_RESUME, voice.sound.id, voice.priority );
+		++m_voiceStats.resumed;
+		startSound( voice.sound, voice.volume, true, voice.priority, &voice );
+
+		if( m_virtualVoices.empty() )
+		{
+			return;
+		}
+	}
+}
+
+void SoundPool::pauseVirtualVoices( int soundId, bool isPaused )
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	for( auto && voice : m_virtualVoices )
+	{
+		if( ( soundId != 0 && voice.sound.id != soundId ) || voice.isPaused == isPaused )
+		{
+			continue;
+		}
+
+		//Time of pause doesn't count to its position
+		if( isPaused )
+		{
+			voice.pauseTime = now;
+		}
+		else
+		{
+			voice.startTime += now - voice.pauseTime;
+		}
+
+		voice.isPaused = isPaused;
+	}
+}
+
+void SoundPool::pollEvents( std::vector<SoundEvent>& events )
+{
+	events.clear();
+	BufferQueue::Event event;
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		while( pElement->events.pop( event ) )
+		{
+			events.emplace_back( event.type, Sound( event.soundId, event.soundPosition ), event.frame );
+		}
+
+		m_voiceStats.eventsDropped += pElement->eventsDropped.exchange( 0, std::memory_order_relaxed );
+	}
+}
+
+void SoundPool::setMarker( const Sound& sound, long long frame )
+{
+	ResourceBuffer* pResource = getResource( sound );
+
+	if( pResource == nullptr )
+	{
+		KLOG( "No such sample: %d", sound.id );
+		return;
+	}
+
+	pResource->markerFrame = frame;
+}
+
+long long SoundPool::getPosition( const Sound& sound ) const
+{
+	const BufferQueue* pLatest = nullptr;
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId != sound.id )
+		{
+			continue;
+		}
+
+		if( pLatest == nullptr || pElement->startTime > pLatest->startTime )
+		{
+			pLatest = pElement;
+		}
+	}
+
+	if( pLatest == nullptr )
+	{
+		return -1;
+	}
+
+	return pLatest->getFrame( pLatest->playedFrames.load( std::memory_order_relaxed ) );
+}
+
+const LatencyStats& SoundPool::getLatencyStats()
+{
+	LatencyStats::PlayTiming timing;
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		while( pElement->playTimings.pop( timing ) )
+		{
+			m_latencyStats.addRecentPlay( timing );
+		}
+	}
+
+	return m_latencyStats;
+}
+
+void SoundPool::resetLatencyStats()
+{
+	//Plays which are waiting in voices are old too
+	getLatencyStats();
+	m_latencyStats.reset();
+}
+
+SLmillibel SoundPool::toMillibel( float volume ) const
+{
+	return int ( ( m_maxVolume - m_minVolume ) * volume ) + m_minVolume;
+}
+
+void SoundPool::pauseSound( const Sound& sound )
+{
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == sound.id )
+		{
+			SLresult result;
+			result = pElement->setPlayState( SL_PLAYSTATE_PAUSED );
+			KTRACE( CONTROL_PAUSE, sound.id );
+			assert( SL_RESULT_SUCCESS == result );
+		}
+	}
+
+	pauseVirtualVoices( sound.id, true );
+}
+
+void SoundPool::resumeSound( const Sound& sound )
+{
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == sound.id )
+		{
+			SLresult result;
+			result = pElement->setPlayState( SL_PLAYSTATE_PLAYING );
+			KTRACE( CONTROL_RESUME, sound.id );
+			assert( SL_RESULT_SUCCESS == result );
+		}
+	}
+
+	pauseVirtualVoices( sound.id, false );
+}
+
+void SoundPool::stopSound( const Sound& sound )
+{
+	if( m_isBatching )
+	{
+		//Plays of this sound earlier in the batch won't happen at all
+		removeBatched( sound.id );
+		m_batchedStops.push_back( sound );
+		return;
+	}
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == sound.id )
+		{
+			pElement->acquire();
+			SLresult result;
+			result = pElement->stop();
+			pElement->release();
+			KTRACE( CONTROL_STOP, sound.id );
+			assert( SL_RESULT_SUCCESS == result );
+		}
+	}
+
+	m_virtualVoices.erase( std::remove_if( m_virtualVoices.begin(), m_virtualVoices.end(),
+										   [&sound]( const VirtualVoice & voice )
+	{
+		return voice.sound.id == sound.id;
+	} ), m_virtualVoices.end() );
+}
+
+void SoundPool::pauseAllSounds()
+{
+	KTRACE( CONTROL_PAUSE_ALL );
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == 0 )
+		{
+			continue;
+		}
+
+		SLresult result;
+		result = pElement->setPlayState( SL_PLAYSTATE_PAUSED );
+		assert( SL_RESULT_SUCCESS == result );
+	}
+
+	pauseVirtualVoices( 0, true );
+}
+
+void SoundPool::resumeAllSounds()
+{
+	KTRACE( CONTROL_RESUME_ALL );
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == 0 )
+		{
+			continue;
+		}
+
+		SLresult result;
+		result = pElement->setPlayState( SL_PLAYSTATE_PLAYING );
+		assert( SL_RESULT_SUCCESS == result );
+	}
+
+	pauseVirtualVoices( 0, false );
+}
+
+
+void SoundPool::stopAllSounds()
+{
+	KTRACE( CONTROL_STOP_ALL );
+
+	if( m_isBatching )
+	{
+		m_batchedPlays.clear();
+		m_batchedStops.clear();
+		m_batchedControls.clear();
+		m_isBatchStopAll = true;
+		return;
+	}
+
+	for( auto && pElement : m_bufferQueues )
+	{
+		if( pElement->playingSoundId == 0 )
+		{
+			continue;
+		}
+
+		pElement->acquire();
+		SLresult result;
+		result = pElement->stop();
+		pElement->release();
+		assert( SL_RESULT_SUCCESS == result );
+	}
+
+	m_virtualVoices.clear();
+}
+
+SLresult SoundPool::initializeBufferQueueAudioPlayer( int maxStreams, int stereoStreams )
+{
+	KLOG( "Initializing BufferQueueAudioPlayer" );
+	SLresult result;
+
+	// configure audio source
+	SLDataLocator_AndroidSimpleBufferQueue loc_bufq = {SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, BUFFER_QUEUE_SIZE};
+	SLDataFormat_PCM format_mono = {SL_DATAFORMAT_PCM, 1, m_samplingRate, m_bitrate, m_bitrate,
+									SL_SPEAKER_FRONT_CENTER , SL_BYTEORDER_LITTLEENDIAN
+								   };
+	SLDataFormat_PCM format_stereo = {SL_DATAFORMAT_PCM, 2, m_samplingRate, m_bitrate, m_bitrate,
+									  SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT, SL_BYTEORDER_LITTLEENDIAN
+									 };
+
+	SLDataSource monoSource = {&loc_bufq, &format_mono};
+	SLDataSource stereoSource = {&loc_bufq, &format_stereo};
+
+	// create audio player
+	const SLInterfaceID player_ids[] = {SL_IID_BUFFERQUEUE, SL_IID_PLAY, SL_IID_VOLUME};
+	const SLboolean player_req[] = {SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE, SL_BOOLEAN_TRUE};
+
+	static_assert( SIZE( player_ids ) == SIZE( player_req ), "Set on both values" );
+
+	KLOG( "Creating %i streams, %i of them stereo", maxStreams, stereoStreams );
+
+	//Stereo first, they were asked for explicitly and we may run out of players
+	for( int i = 0; i < maxStreams; ++i )
+	{
+		BufferQueue* pBufferQueue = new BufferQueue();
+		pBufferQueue->channels = i < stereoStreams ? 2 : 1;
+		pBufferQueue->pLatencyStats = &m_latencyStats;
+		SLDataSource* pAudioSource = pBufferQueue->channels == 2 ? &stereoSource : &monoSource;
+
+		// configure audio sink
+		SLDataLocator_OutputMix loc_outmix = {SL_DATALOCATOR_OUTPUTMIX, m_pEngine->getOutputMixObject() };
+		SLDataSink audioSnk = {&loc_outmix, NULL};
+
+		//SLVolumeItf volume;
+		KLOG( "Creating SLAndroidSimpleBufferQueueItf" );
+
+		result = ( *m_pEngine->getEngine() )->CreateAudioPlayer( m_pEngine->getEngine(),
+				 &pBufferQueue->player, pAudioSource, &audioSnk, SIZE( player_ids ), player_ids, player_req );
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			delete pBufferQueue;
+			KLOG( "Can't create more players" );
+			break;
+		}
+
+		result = pBufferQueue->realize();
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			delete pBufferQueue;
+			KLOG( "Can't realize player" );
+			break;
+		}
+
+		result = pBufferQueue->setPlayState( SL_PLAYSTATE_PLAYING );
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			delete pBufferQueue;
+			KLOG( "Can't set player state" );
+			break;
+		}
+
+		m_bufferQueues.push_back( pBufferQueue );
+		KLOG( "Created stream %d channels %d", i, pBufferQueue->channels );
+	}
+
+	if( m_bufferQueues.empty() )
+	{
+		return result;
+	}
+
+	assert( m_bufferQueues.empty() == false );
+	BufferQueue* pBufferQueue = m_bufferQueues.front();
+
+	KLOG( "Getting max volume level" );
+	result = ( *pBufferQueue->volume )->GetMaxVolumeLevel( pBufferQueue->volume, &m_maxVolume );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	KLOG( "createBufferQueueAudioPlayer done" );
+	return result;
+}
+
+SLresult BufferQueue::realize()
+{
+	SLresult result;
+	// realize the player
+	KLOG( "Realize player" );
+	result = ( *player )->Realize( player, SL_BOOLEAN_FALSE );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	// get the play interface
+	KLOG( "Get Player interface" );
+	result = ( *player )->GetInterface( player, SL_IID_PLAY, &playerPlay );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	// get the buffer queue interface
+	KLOG( "Get buffer queue interface" );
+	result = ( *player )->GetInterface( player, SL_IID_BUFFERQUEUE, &queue );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	// register callback on the buffer queue
+	KLOG( "Register callback for buffer queue" );
+	result = ( *queue )->RegisterCallback( queue, BufferQueue::playerCallback, this );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	KLOG( "Get interface for volume" );
+	result = ( *player )->GetInterface( player, SL_IID_VOLUME, &volume );
+
+	return result;
+}
+
+float BufferQueue::getVolume( std::chrono::steady_clock::time_point now ) const
+{
+	if( isRamping == false || rampMilliseconds < 1 )
+	{
+		return rampTo;
+	}
+
+	const float elapsed = std::chrono::duration<float, std::milli>( now - rampStart ).count();
+	return elapsed >= rampMilliseconds ? rampTo : rampFrom + ( rampTo - rampFrom ) * elapsed / rampMilliseconds;
+}
+
+SLresult BufferQueue::setPlayState( SLuint32 state )
+{
+	if( state == playState )
+	{
+		return SL_RESULT_SUCCESS;
+	}
+
+	SLresult result = ( *playerPlay )->SetPlayState( playerPlay, state );
 
 	if( result != SL_RESULT_SUCCESS )
 	{
-		return result;
+		return result;
+	}
+
+	//Time of pause doesn't count to position of sound, see SoundPool::VirtualVoice
+	const auto now = std::chrono::steady_clock::now();
+
+	if( state == SL_PLAYSTATE_PAUSED )
+	{
+		pauseTime = now;
+	}
+	else if( state == SL_PLAYSTATE_PLAYING && playState == SL_PLAYSTATE_PAUSED )
+	{
+		//Stopped sound doesn't need it, start() stops paused voice after startTime of new sound is set
+		startTime += now - pauseTime;
+	}
+
+#ifdef KOALA_LATENCY_STATS
+
+	//Paused or stopped time isn't latency nor jitter
+	if( state != SL_PLAYSTATE_PLAYING )
+	{
+		isFirstCallbackPending.store( false, std::memory_order_relaxed );
+		lastCallbackTime.store( 0, std::memory_order_relaxed );
+	}
+
+#endif
+
+	playState = state;
+	return result;
+}
+
+SLresult BufferQueue::setStereoPosition( SLpermille position )
+{
+	if( position == stereoPosition )
+	{
+		return SL_RESULT_SUCCESS;
 	}
 
-	// get the play interface
-	KLOG( "Get Player interface" );
-	result = ( *player )->GetInterface( player, SL_IID_PLAY, &playerPlay );
+	SLresult result;
 
-	if( result != SL_RESULT_SUCCESS )
+	if( isStereoPositionEnabled == false )
 	{
-		return result;
+		result = ( *volume )->EnableStereoPosition( volume, SL_BOOLEAN_TRUE );
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			return result;
+		}
+
+		isStereoPositionEnabled = true;
 	}
 
-	// get the buffer queue interface
-	KLOG( "Get buffer queue interface" );
-	result = ( *player )->GetInterface( player, SL_IID_BUFFERQUEUE, &queue );
+	result = ( *volume )->SetStereoPosition( volume, position );
 
-	if( result != SL_RESULT_SUCCESS )
+	if( result == SL_RESULT_SUCCESS )
 	{
-		return result;
+		stereoPosition = position;
 	}
 
-	// register callback on the buffer queue
-	KLOG( "Register callback for buffer queue" );
-	result = ( *queue )->RegisterCallback( queue, BufferQueue::playerCallback, this );
+	return result;
+}
 
-	if( result != SL_RESULT_SUCCESS )
+SLresult BufferQueue::setVolumeLevel( SLmillibel level )
+{
+	if( level == volumeLevel )
 	{
-		return result;
+		return SL_RESULT_SUCCESS;
 	}
 
-	KLOG( "Get interface for volume" );
-	result = ( *player )->GetInterface( player, SL_IID_VOLUME, &volume );
+	SLresult result = ( *volume )->SetVolumeLevel( volume, level );
+
+	if( result == SL_RESULT_SUCCESS )
+	{
+		volumeLevel = level;
+	}
 
 	return result;
 }
@@ -486,27 +1631,96 @@ SLresult BufferQueue::realize()
 ResourceBuffer::ResourceBuffer() :
 	pBuffer( nullptr )
 	, size( 0 )
+	, loopOffset( 0 )
+	, loopSize( 0 )
+	, channels( 1 )
+	, isAdpcm( false )
+	, pEncoded( nullptr )
+	, encodedSize( 0 )
+	, isStreamed( false )
+	, maxInstances( 0 )
+	, minRetriggerMilliseconds( 0 )
+	, stealPolicy( StealPolicy::OLDEST )
+	, hasPlayed( false )
+	, markerFrame( -1 )
 {
 }
 
 ResourceBuffer::~ResourceBuffer()
 {
+	if( pEncoded != nullptr )
+	{
+		releaseDecoded();
+		free( pEncoded );
+		pEncoded = nullptr;
+		encodedSize = 0;
+		return;
+	}
+
 	assert( pBuffer != nullptr );
 	free( pBuffer );
 	pBuffer = nullptr;
 	size = 0;
 }
 
+void ResourceBuffer::releaseDecoded()
+{
+	assert( pEncoded != nullptr );
+	//Decoded by OggDecoder so it was allocated with new[]
+	delete[] pBuffer;
+	pBuffer = nullptr;
+	size = 0;
+	loopOffset = 0;
+	loopSize = 0;
+}
+
 BufferQueue::BufferQueue() :
 	queue( nullptr )
 	, player( nullptr )
 	, playerPlay( nullptr )
 	, volume( nullptr )
+	, channels( 1 )
+	, volumeLevel( 0 )
+	, isRamping( false )
+	, rampFrom( 1 )
+	, rampTo( 1 )
+	, rampMilliseconds( 0 )
+	, isStereoPositionEnabled( false )
+	, stereoPosition( 0 )
+	, playState( SL_PLAYSTATE_STOPPED )
+	, isAcquired( false )
+	, isInCallback( false )
 	, playingSoundId( 0 )
+	, soundPosition( 0 )
 	, priority( INT_MIN )
+	, batchId( 0 )
 	, isLooped( false )
-	, pLastBuffer( nullptr )
-	, lastSize( 0 )
+	, pBuffer( nullptr )
+	, position( 0 )
+	, endPosition( 0 )
+	, loopOffset( 0 )
+	, loopSize( 0 )
+	, frameSize( 2 )
+	, queuedBuffers( 0 )
+	, bufferFrames( BUFFER_QUEUE_SIZE, 0 )
+	, playedFrames( 0 )
+	, startFrame( 0 )
+	, loopStartFrame( 0 )
+	, endFrame( 0 )
+	, markerFrame( -1 )
+	, eventsDropped( 0 )
+	, pLatencyStats( nullptr )
+	, requestTime( 0 )
+	, enqueueMicroseconds( 0 )
+	, isFirstCallbackPending( false )
+	, lastCallbackTime( 0 )
+	, isAdpcm( false )
+	, chunkBufferIndex( 0 )
+	, isStreaming( false )
+	, pStream( nullptr )
+	, streamPosition( 0 )
+	, streamEnd( 0 )
+	, streamLoopStart( 0 )
 {
 }
 
@@ -532,33 +1746,463 @@ BufferQueue::~BufferQueue()
 	isLooped = false;
 	playingSoundId = 0;
 	priority = INT_MIN;
+
+	//Player is destroyed so callback can't use it anymore
+	delete pStream;
+	pStream = nullptr;
+	isStreaming = false;
+}
+
+void BufferQueue::acquire()
+{
+	assert( isAcquired.load( std::memory_order_relaxed ) == false );
+
+	//Both sides store their flag and then load the other one, all sequentially consistent. Either callback
+	//sees isAcquired or we see it is in.
+	isAcquired.store( true );
+
+	while( isInCallback.load() )
+	{
+		std::this_thread::yield();
+	}
+}
+
+void BufferQueue::release()
+{
+	isAcquired.store( false, std::memory_order_release );
+}
+
+SLresult BufferQueue::stop()
+{
+	assert( isAcquired.load( std::memory_order_relaxed ) );
+	const SLresult result = setPlayState( SL_PLAYSTATE_STOPPED );
+	playingSoundId = 0;
+	priority = INT_MIN;
+	batchId = 0;
+	return result;
+}
+
+SLresult BufferQueue::start( ResourceBuffer* pResource, bool isLooped, bool isStreamed, long long startFrame )
+{
+	assert( pResource );
+	assert( isAcquired.load( std::memory_order_relaxed ) );
+
+	//Stopped player takes no buffer, so we don't miss callback of any while voice is acquired
+	SLresult result = setPlayState( SL_PLAYSTATE_STOPPED );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	//Queue of sound which ended by itself is already empty
+	if( queuedBuffers > 0 )
+	{
+		result = ( *queue )->Clear( queue );
+		queuedBuffers = 0;
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			return result;
+		}
+	}
+
+	this->isLooped = isLooped;
+	isStreaming = isStreamed;
+	isAdpcm = false;
+	chunkBufferIndex = 0;
+	this->startFrame = startFrame;
+	playedFrames.store( 0, std::memory_order_relaxed );
+	markerFrame = pResource->markerFrame;
+
+	if( isStreamed )
+	{
+		pBuffer = nullptr;
+		result = openStream( pResource, startFrame );
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			isStreaming = false;
+			return result;
+		}
+	}
+	else
+	{
+		startBuffer( pResource, startFrame );
+	}
+
+	//Enqueue ahead as much as we can. Next loop iteration is queued before previous ends.
+	while( queuedBuffers < BUFFER_QUEUE_SIZE )
+	{
+		result = enqueueNext();
+
+		if( result != SL_RESULT_SUCCESS )
+		{
+			break;
+		}
+	}
+
+	return queuedBuffers > 0 ? SL_RESULT_SUCCESS : result;
+}
+
+/**
+ * @return frame of looped sound which plays elapsedFrames after its start. Intro before loop body plays once.
+ */
+static long long getLoopedFrame( long long elapsedFrames, long long loopStart, long long loopEnd )
+{
+	if( elapsedFrames < loopEnd || loopEnd <= loopStart )
+	{
+		return elapsedFrames;
+	}
+
+	return loopStart + ( elapsedFrames - loopEnd ) % ( loopEnd - loopStart );
+}
+
+void BufferQueue::startBuffer( ResourceBuffer* pResource, long long startFrame )
+{
+	pBuffer = pResource->pBuffer;
+	position = 0;
+	loopOffset = pResource->loopOffset;
+	loopSize = pResource->loopSize;
+	//When looped we play intro and loop body, rest of sound is never heard
+	endPosition = isLooped ? loopOffset + loopSize : pResource->size;
+	frameSize = 2 * pResource->channels;
+	isAdpcm = pResource->isAdpcm;
+	loopStartFrame = loopOffset / frameSize;
+	endFrame = endPosition / frameSize;
+
+	if( startFrame > 0 )
+	{
+		const long long frame = isLooped ? getLoopedFrame( startFrame, loopOffset / frameSize,
+								( loopOffset + loopSize ) / frameSize ) : startFrame;
+		position = static_cast<int>( std::min<long long>( frame * frameSize, endPosition ) );
+	}
+
+	if( isAdpcm )
+	{
+		//Callback which decodes to chunk buffers waits for release(), so they may move now
+		assert( isAcquired.load( std::memory_order_relaxed ) );
+		chunkBuffers.resize( BUFFER_QUEUE_SIZE * ( ADPCM_CHUNK_FRAMES + ADPCM_CHUNK_FRAMES / 2 ) * frameSize );
+	}
+}
+
+SLresult BufferQueue::enqueueNext()
+{
+	if( isStreaming )
+	{
+		return enqueueDecoded();
+	}
+
+	if( position >= endPosition )
+	{
+		if( isLooped == false || loopSize < 1 )
+		{
+			return SL_RESULT_BUFFER_INSUFFICIENT;
+		}
+
+		position = loopOffset;
+		endPosition = loopOffset + loopSize;
+	}
+
+	int size = endPosition - position;
+	//ADPCM is decoded to chunk buffer first, it needs smaller chunks
+	const int chunkSize = isAdpcm ? ADPCM_CHUNK_FRAMES * frameSize : CHUNK_SIZE_BYTES;
+
+	//Don't leave tiny tail after last chunk, it would cost us extra callback
+	if( size > chunkSize + chunkSize / 2 )
+	{
+		size = chunkSize;
+	}
+
+	char* pChunk = pBuffer + position;
+
+	if( isAdpcm )
+	{
+		/* Buffer which finished last (or was never used). Others are still queued. On callback thread
+		 * unless start() enqueues it on acquired voice, see playerCallback(). */
+		pChunk = chunkBuffers.data() + chunkBufferIndex * ( chunkSize + chunkSize / 2 );
+		ImaAdpcm::decode( pBuffer, position / frameSize, size / frameSize, reinterpret_cast<short*>( pChunk ) );
+	}
+
+	SLresult result = ( *queue )->Enqueue( queue, static_cast<void*>( pChunk ), size );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	bufferFrames[chunkBufferIndex] = size / frameSize;
+	chunkBufferIndex = ( chunkBufferIndex + 1 ) % BUFFER_QUEUE_SIZE;
+
+	position += size;
+	++queuedBuffers;
+	return result;
+}
+
+SLresult BufferQueue::openStream( ResourceBuffer* pResource, long long startFrame )
+{
+	assert( pResource->pEncoded != nullptr );
+
+	if( pStream == nullptr )
+	{
+		pStream = new OggStream();
+	}
+
+	//Headers are parsed again on every play. It is small part of decoding whole sound.
+	if( pStream->open( pResource->pEncoded, pResource->encodedSize ) == false )
+	{
+		return SL_RESULT_CONTENT_CORRUPTED;
+	}
+
+	const long long length = pStream->getLength();
+	int loopStart = 0;
+	int loopLength = 0;
+	streamLoopStart = 0;
+	long long loopEnd = length;
+
+	if( OggDecoder::readLoopPoints( pStream->getComment(), loopStart, loopLength ) && loopStart < length )
+	{
+		streamLoopStart = loopStart;
+		loopEnd = std::min<long long>( loopStart + loopLength, length );
+	}
+
+	//Like resident sound, when looped rest of sound after loop body is never heard
+	streamEnd = isLooped ? loopEnd : length;
+	streamPosition = 0;
+	frameSize = 2 * pStream->getChannelsCount();
+	loopStartFrame = streamLoopStart;
+	endFrame = streamEnd;
+
+	if( startFrame > 0 )
+	{
+		streamPosition = isLooped ? getLoopedFrame( startFrame, streamLoopStart, streamEnd ) :
+						 std::min( startFrame, streamEnd );
+
+		if( streamPosition < streamEnd && pStream->seek( streamPosition ) == false )
+		{
+			return SL_RESULT_CONTENT_CORRUPTED;
+		}
+	}
+
+	chunkBuffers.resize( BUFFER_QUEUE_SIZE * STREAM_CHUNK_FRAMES * frameSize );
+	return SL_RESULT_SUCCESS;
+}
+
+SLresult BufferQueue::enqueueDecoded()
+{
+	/* Buffer which finished last (or was never used). Others are still queued. */
+	char* pChunk = chunkBuffers.data() + chunkBufferIndex * STREAM_CHUNK_FRAMES * frameSize;
+	int frames = 0;
+
+	while( frames < STREAM_CHUNK_FRAMES )
+	{
+		if( streamPosition >= streamEnd )
+		{
+			if( isLooped == false || streamEnd <= streamLoopStart || pStream->seek( streamLoopStart ) == false )
+			{
+				break;
+			}
+
+			streamPosition = streamLoopStart;
+		}
+
+		const int wanted = static_cast<int>( std::min<long long>( STREAM_CHUNK_FRAMES - frames,
+											 streamEnd - streamPosition ) );
+		const int decoded = pStream->read( pChunk + frames * frameSize, wanted );
+
+		if( decoded <= 0 )
+		{
+			//Stream is shorter than it claims or broken, treat it as its end
+			streamEnd = streamPosition;
+			break;
+		}
+
+		frames += decoded;
+		streamPosition += decoded;
+	}
+
+	if( frames == 0 )
+	{
+		return SL_RESULT_BUFFER_INSUFFICIENT;
+	}
+
+	SLresult result = ( *queue )->Enqueue( queue, static_cast<void*>( pChunk ), frames * frameSize );
+
+	if( result != SL_RESULT_SUCCESS )
+	{
+		return result;
+	}
+
+	bufferFrames[chunkBufferIndex] = frames;
+	chunkBufferIndex = ( chunkBufferIndex + 1 ) % BUFFER_QUEUE_SIZE;
+	++queuedBuffers;
+	return result;
+}
+
+long long BufferQueue::getFrame( long long played ) const
+{
+	const long long frame = startFrame + played;
+	return std::min( isLooped ? getLoopedFrame( frame, loopStartFrame, endFrame ) : frame, endFrame );
+}
+
+void BufferQueue::onBufferPlayed( int frames )
+{
+	const long long played = playedFrames.load( std::memory_order_relaxed );
+	playedFrames.store( played + frames, std::memory_order_relaxed );
+
+	if( playingSoundId == 0 )
+	{
+		return;
+	}
+
+	const long long begin = startFrame + played;
+	const long long end = begin + frames;
+
+	if( markerFrame >= 0 && isMarkerBetween( begin, end ) )
+	{
+		sendEvent( SoundEventType::MARKER, markerFrame );
+	}
+
+	const long long loopLength = endFrame - loopStartFrame;
+
+	//Next frame after end of loop body is loop start again
+	if( isLooped && loopLength > 0 && end >= endFrame &&
+			( begin < endFrame || ( end - endFrame ) / loopLength > ( begin - endFrame ) / loopLength ) )
+	{
+		sendEvent( SoundEventType::LOOPED, loopStartFrame );
+	}
+}
+
+bool BufferQueue::isMarkerBetween( long long begin, long long end ) const
+{
+	if( markerFrame >= endFrame )
+	{
+		return false;
+	}
+
+	//First pass, also intro of looped sound
+	if( markerFrame >= begin && markerFrame < end )
+	{
+		return true;
+	}
+
+	const long long loopLength = endFrame - loopStartFrame;
+
+	if( isLooped == false || loopLength < 1 || markerFrame < loopStartFrame )
+	{
+		return false;
+	}
+
+	//Marker in loop body is passed again in every iteration, first time here
+	const long long repeated = endFrame + markerFrame - loopStartFrame;
+
+	if( end <= repeated )
+	{
+		return false;
+	}
+
+	const long long from = std::max( begin, repeated );
+	const long long next = repeated + ( from - repeated + loopLength - 1 ) / loopLength * loopLength;
+	return next < end;
+}
+
+void BufferQueue::sendEvent( SoundEventType type, long long frame )
+{
+	const Event event = { type, playingSoundId, soundPosition, frame };
+
+	if( events.push( event ) == false )
+	{
+		eventsDropped.fetch_add( 1, std::memory_order_relaxed );
+	}
+}
+
+void BufferQueue::measurePlay( std::chrono::steady_clock::time_point request )
+{
+	//Callback of previous sound mustn't take times we change
+	isFirstCallbackPending.store( false, std::memory_order_relaxed );
+
+	const long long time = std::chrono::duration_cast<std::chrono::microseconds>(
+							   request.time_since_epoch() ).count();
+	const int enqueue = static_cast<int>( LatencyStats::now() - time );
+	pLatencyStats->playToEnqueue.add( enqueue );
+
+	requestTime.store( time, std::memory_order_relaxed );
+	enqueueMicroseconds.store( enqueue, std::memory_order_relaxed );
+	lastCallbackTime.store( 0, std::memory_order_relaxed );
+	isFirstCallbackPending.store( true, std::memory_order_release );
+}
+
+void BufferQueue::measureCallback( int frames )
+{
+	const long long now = LatencyStats::now();
+	const long long last = lastCallbackTime.exchange( now, std::memory_order_relaxed );
+
+	if( isFirstCallbackPending.exchange( false, std::memory_order_acquire ) )
+	{
+		const int enqueue = enqueueMicroseconds.load( std::memory_order_relaxed );
+		const long long request = requestTime.load( std::memory_order_relaxed );
+		const int firstCallback = static_cast<int>( now - request );
+		const LatencyStats::PlayTiming timing = { playingSoundId, enqueue, firstCallback, frames };
+		pLatencyStats->playToCallback.add( timing.firstCallbackMicroseconds );
+
+		//Histogram has it already, only recent plays list misses it when game doesn't ask for it
+		playTimings.push( timing );
+		return;
+	}
+
+	if( last != 0 && pLatencyStats->getSampleRate() > 0 )
+	{
+		//Finished buffer played since last callback, it should take as long as its length
+		const long long length = frames * 1000000LL / pLatencyStats->getSampleRate();
+		pLatencyStats->callbackJitter.add( std::abs( now - last - length ) );
+	}
 }
 
 void BufferQueue::playerCallback( SLBufferQueueItf bufferQueue, void* pContext )
 {
 	assert( pContext );
 	BufferQueue* pBufferContext = static_cast<BufferQueue*>( pContext );
-	KLOG( "Playing ended %d with priority %d", pBufferContext->playingSoundId ,
-		  pBufferContext->priority );
 
-	if( pBufferContext->isLooped )
+	//Game thread replaces sound of voice just now, see acquire()
+	pBufferContext->isInCallback.store( true );
+
+	if( pBufferContext->isAcquired.load() )
 	{
-		//enqueue the sound
-		SLresult result = ( *pBufferContext->queue )->Enqueue( pBufferContext->queue,
-						  static_cast<void*>( pBufferContext->pLastBuffer ), pBufferContext->lastSize );
-		assert( result == SL_RESULT_SUCCESS );
+		pBufferContext->isInCallback.store( false, std::memory_order_release );
+		return;
+	}
 
-		result = ( * ( pBufferContext->playerPlay ) )->SetMarkerPosition( pBufferContext->playerPlay, 0 );
-		assert( SL_RESULT_SUCCESS == result );
-		result = ( *pBufferContext->playerPlay )->SetPlayState( pBufferContext->playerPlay,
-				 SL_PLAYSTATE_PLAYING );
-		assert( SL_RESULT_SUCCESS == result );
+	if( pBufferContext->queuedBuffers > 0 )
+	{
+		//Buffers finish in order they were enqueued
+		const int finished = ( pBufferContext->chunkBufferIndex + BUFFER_QUEUE_SIZE -
+							   pBufferContext->queuedBuffers ) % BUFFER_QUEUE_SIZE;
+		KTRACE( CALLBACK_BUFFER, pBufferContext->playingSoundId, pBufferContext->bufferFrames[finished],
+				pBufferContext->queuedBuffers - 1 );
+		KLATENCY( pBufferContext->measureCallback( pBufferContext->bufferFrames[finished] ) );
+		pBufferContext->onBufferPlayed( pBufferContext->bufferFrames[finished] );
+		--pBufferContext->queuedBuffers;
 	}
-	else
+
+	//We only top up the queue, player never stops between chunks or loop iterations
+	pBufferContext->enqueueNext();
+
+	if( pBufferContext->queuedBuffers == 0 )
 	{
+		KTRACE( CALLBACK_END, pBufferContext->playingSoundId, pBufferContext->priority );
+
+		//Stopped sound has no id anymore, only sound which played to its end completes
+		if( pBufferContext->playingSoundId != 0 )
+		{
+			pBufferContext->sendEvent( SoundEventType::COMPLETED,
+									   pBufferContext->getFrame( pBufferContext->playedFrames.load() ) );
+		}
+
 		pBufferContext->playingSoundId = 0;
 		pBufferContext->priority = INT_MIN;
 	}
+
+	pBufferContext->isInCallback.store( false, std::memory_order_release );
 }
 
 } /* namespace KoalaSound */
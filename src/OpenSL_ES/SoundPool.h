@@ -8,9 +8,17 @@
 #ifndef SOUNDPOOL_H_
 #define SOUNDPOOL_H_
 
+#include <atomic>
+#include <chrono>
+#include <list>
 #include <vector>
 
+#include "LatencyStats.h"
 #include "OpenSLEngine.h"
+#include "SpscQueue.h"
+#include "decoders/ImaAdpcm.h"
+#include "decoders/OggDecoder.h"
+#include "decoders/OggStream.h"
 
 namespace KoalaSound
 {
@@ -39,6 +47,165 @@ private:
 class ResourceBuffer;
 class BufferQueue;
 
+/**
+ * Which voice of sound is reused when play() would exceed its instance limit, see SoundPool::setSoundLimits()
+ */
+enum class StealPolicy
+{
+	OLDEST,
+	QUIETEST,
+	/**
+	 * Only if its priority isn't higher than priority of new play
+	 */
+	LOWEST_PRIORITY,
+	/**
+	 * New play is rejected
+	 */
+	NONE
+};
+
+enum class SoundEventType
+{
+	/**
+	 * Sound played to its end. Stopped or stolen sounds don't send it.
+	 */
+	COMPLETED,
+	/**
+	 * Looped sound jumped back to start of its loop body
+	 */
+	LOOPED,
+	/**
+	 * Sound passed frame set by SoundPool::setMarker()
+	 */
+	MARKER
+};
+
+/**
+ * Something which happened to playing sound, see SoundPool::pollEvents()
+ */
+struct SoundEvent
+{
+	SoundEvent( SoundEventType type, const Sound& sound, long long frame ) :
+		type( type )
+		, sound( sound )
+		, frame( frame )
+	{
+	}
+
+	SoundEventType type;
+	Sound sound;
+	/**
+	 * Frame of sound where it happened: end of sound, loop start or marker
+	 */
+	long long frame;
+};
+
+/**
+ * Counters of play() outcomes
+ */
+struct VoiceStats
+{
+	VoiceStats() :
+		plays( 0 )
+		, rejectedRetrigger( 0 )
+		, rejectedLimit( 0 )
+		, stolenByLimit( 0 )
+		, stolenByPriority( 0 )
+		, noVoice( 0 )
+		, virtualized( 0 )
+		, resumed( 0 )
+		, virtualDropped( 0 )
+		, eventsDropped( 0 )
+	{
+	}
+
+	/**
+	 * Sounds started
+	 */
+	int plays;
+	/**
+	 * Plays rejected because sound was played less than its minimal retrigger interval ago, or because it
+	 * plays maximum instances and steal policy didn't allow to replace any of them. Virtual voices which
+	 * would resume over maximum instances are dropped and counted as rejected by limit too.
+	 */
+	int rejectedRetrigger;
+	int rejectedLimit;
+	/**
+	 * Plays which replaced instance of the same sound because of instance limit
+	 */
+	int stolenByLimit;
+	/**
+	 * Plays which stopped other sound with lower or equal priority
+	 */
+	int stolenByPriority;
+	/**
+	 * Plays dropped because all voices play sounds with higher priority
+	 */
+	int noVoice;
+	/**
+	 * Looped sounds which lost their player (or didn't get any) and became virtual, virtual voices which got
+	 * player again and those forgotten because there were too many of them
+	 */
+	int virtualized;
+	int resumed;
+	int virtualDropped;
+	/**
+	 * Events lost because pollEvents() wasn't called often enough
+	 */
+	int eventsDropped;
+};
+
+/**
+ * Counters of decoded PCM cache used by sounds loaded with SoundPool::loadCompressed()
+ */
+struct DecodeStats
+{
+	DecodeStats() :
+		hits( 0 )
+		, misses( 0 )
+		, prefetches( 0 )
+		, evictions( 0 )
+		, streamedPlays( 0 )
+		, streamFallbacks( 0 )
+		, stallMicroseconds( 0 )
+		, maxStallMicroseconds( 0 )
+		, residentBytes( 0 )
+	{
+	}
+
+	/**
+	 * Plays of sounds which were already decoded
+	 */
+	int hits;
+	/**
+	 * Plays which had to decode first. Each of them is a decode stall of play()
+	 */
+	int misses;
+	/**
+	 * Decodes done by prefetch()
+	 */
+	int prefetches;
+	/**
+	 * Decoded sounds dropped to stay within budget
+	 */
+	int evictions;
+	/**
+	 * Plays of loadStreamed() sounds decoded by voice, and those which were decoded whole because all
+	 * streamed voices were busy (they are counted as misses too)
+	 */
+	int streamedPlays;
+	int streamFallbacks;
+	/**
+	 * Time spent decoding inside play(), total and the longest one
+	 */
+	long long stallMicroseconds;
+	long long maxStallMicroseconds;
+	/**
+	 * Decoded PCM currently in memory
+	 */
+	size_t residentBytes;
+};
+
 class SoundPool
 {
 public:
@@ -53,10 +220,12 @@ public:
 	 * 			On android you have limit for 32 audio player so you probably will have ~25 max.
 	 * @param samplingRate
 	 * @param bitrate
+	 * @param stereoStreams how many of maxStreams are stereo players, rest is mono. Sound plays only on player
+	 * 			with its channels count. Sounds which have no such player are converted when loaded.
 	 * @return true if everything is ok, false otherwise
 	 */
 	bool init( int maxStreams, SLuint32 samplingRate = SL_SAMPLINGRATE_44_1,
-			   SLuint32 bitrate = SL_PCMSAMPLEFORMAT_FIXED_16 );
+			   SLuint32 bitrate = SL_PCMSAMPLEFORMAT_FIXED_16, int stereoStreams = 0 );
 
 	void unloadStreams();
 	void unloadResources();
@@ -80,10 +249,99 @@ public:
 	/**
 	 * @param pBuffer
 	 * @param length
+	 * @param loopStart first frame of loop body (see Data::loopStart). Looped sound plays from beginning to
+	 * 			end of loop body once (intro) and then repeats only loop body.
+	 * @param loopLength count of frames in loop body. 0 means whole sound is looped.
+	 * @param channels 1 for mono PCM, 2 for interleaved stereo (see Data::channelsCount). If pool has no player
+	 * 			for it, PCM is converted here and pBuffer is replaced (so it must be allocated with malloc).
 	 * @return sample id which is used to other actions on this sound pool. 0 is returned if any error occurs.
 	 * 			0 is invalid sample id and it won't be played
 	 */
-	Sound load( char* pBuffer, int length );
+	Sound load( char* pBuffer, int length, int loopStart = 0, int loopLength = 0, int channels = 1 );
+
+	/**
+	 * Register .ogg sound without decoding it. It is decoded on first play (or prefetch()) and decoded
+	 * PCM is kept while it fits in budget (see setDecodedBudget()). Least recently played sounds are
+	 * dropped first and decoded again when needed. Loop points are read from LOOPSTART/LOOPLENGTH comments.
+	 * @param pBuffer encoded ogg file allocated with malloc. Pool takes ownership of it.
+	 * @param length size of pBuffer
+	 * @return sample id like from load(). 0 is returned if any error occurs.
+	 */
+	Sound loadCompressed( char* pBuffer, int length );
+
+	/**
+	 * Register IMA-ADPCM sound (see ImaAdpcm, convert with tools/koala_adpcm or ImaAdpcm::encode). It stays
+	 * in memory 4x smaller than PCM and voice decodes it chunk by chunk while playing, which is cheap.
+	 * Loop points are taken from its header. If pool has no player for its channels count, it is decoded here
+	 * and kept as converted PCM.
+	 * @param pBuffer encoded sound allocated with malloc. Pool takes ownership of it.
+	 * @param length size of pBuffer
+	 * @return sample id like from load(). 0 is returned if any error occurs.
+	 */
+	Sound loadAdpcm( char* pBuffer, int length );
+
+	/**
+	 * Register .ogg sound which is decoded while it plays, in audio callback of its voice. Only the ogg file
+	 * stays in memory (~10x smaller than PCM) plus few kB per playing voice, but every playing voice costs
+	 * decoding CPU. Meant for medium-length sounds (2-20 s). Above setMaxStreamedVoices() playing voices
+	 * sound is decoded whole and cached like loadCompressed() one, it is also played from that PCM
+	 * while it stays cached. If pool has no player for its channels count, it is always decoded whole, so it
+	 * can be converted.
+	 * @param pBuffer encoded ogg file allocated with malloc. Pool takes ownership of it.
+	 * @param length size of pBuffer
+	 * @return sample id like from load(). 0 is returned if any error occurs.
+	 */
+	Sound loadStreamed( char* pBuffer, int length );
+
+	/**
+	 * @param count how many voices can decode loadStreamed() sounds at once. Default is 4.
+	 */
+	void setMaxStreamedVoices( int count );
+
+	/**
+	 * Decode sound loaded with loadCompressed() now, so its next play() doesn't wait for decoder.
+	 * Call it when you know sound will be needed soon, e.g. while loading scene.
+	 */
+	void prefetch( const Sound& sound );
+
+	/**
+	 * @param bytes how much decoded PCM of loadCompressed() sounds we keep. Playing sounds are never
+	 * 			dropped so it can be exceeded for a while.
+	 */
+	void setDecodedBudget( size_t bytes );
+
+	inline const DecodeStats& getDecodeStats() const
+	{
+		return m_decodeStats;
+	}
+
+	/**
+	 * Limit how many times sound plays at once and how often it can start. Checked by play() before
+	 * anything else is done, in time independent of count of voices.
+	 * @param maxInstances how many voices can play it at once, 0 means no limit
+	 * @param minRetriggerMilliseconds play() sooner than this after last play which started the sound is
+	 * 			rejected, 0 means no limit
+	 * @param stealPolicy which of its voices play() reuses when sound already plays maxInstances times
+	 */
+	void setSoundLimits( const Sound& sound, int maxInstances, int minRetriggerMilliseconds = 0,
+						 StealPolicy stealPolicy = StealPolicy::OLDEST );
+
+	inline const VoiceStats& getVoiceStats() const
+	{
+		return m_voiceStats;
+	}
+
+	inline void resetVoiceStats()
+	{
+		m_voiceStats = VoiceStats();
+	}
+
+	inline void resetDecodeStats()
+	{
+		const size_t residentBytes = m_decodeStats.residentBytes;
+		m_decodeStats = DecodeStats();
+		m_decodeStats.residentBytes = residentBytes;
+	}
 
 	/**
 	 * @return maximum streams count. This can be different value that you pass in init method. Even 0!
@@ -93,6 +351,84 @@ public:
 		return m_bufferQueues.size();
 	}
 
+	/**
+	 * Change volume of playing sound.
+	 * @param volume volume in range [0,1], like in play()
+	 * @param rampMilliseconds 0 sets volume at once. Otherwise volume slides to new value during this time,
+	 * 			starting from where it is now. Ramps move on in update().
+	 */
+	void setVolume( const Sound& sound, float volume, int rampMilliseconds = 0 );
+
+	/**
+	 * Set stereo position of playing sound. Every play() starts at center.
+	 * @param pan -1 is left, 0 is center and 1 is right
+	 */
+	void setPan( const Sound& sound, float pan );
+
+	/**
+	 * Collect play(), stopSound(), stopAllSounds(), setVolume() and setPan() calls until endBatch(), e.g. all
+	 * sound events of one frame. Pause and resume calls aren't collected.
+	 */
+	void beginBatch();
+
+	/**
+	 * Execute collected calls: stops first, then plays from the highest priority, then volume and pan changes.
+	 * Plays of the same sound with the same isLooped are merged to one, with the highest volume and priority.
+	 * Sound started by the batch isn't stolen by another play of the same batch.
+	 */
+	void endBatch();
+
+	inline bool isBatching() const
+	{
+		return m_isBatching;
+	}
+
+	/**
+	 * Move volume ramps on and give free players to virtual voices. Call it once per frame. Player volume is
+	 * set only when it changed noticeably and at most MAX_VOLUME_CALLS_PER_UPDATE times per call, voices over
+	 * the limit are updated next time.
+	 *
+	 * Looped sound which is stopped by play() of sound with higher priority, or which doesn't get player at
+	 * all, becomes virtual voice. It keeps its volume, pan and priority and its position moves on with time.
+	 * When player with its channels count is free, virtual voice with the highest priority gets it back here
+	 * and continues from where it would be if it never stopped.
+	 */
+	void update();
+
+	inline int getVirtualVoicesCount() const
+	{
+		return m_virtualVoices.size();
+	}
+
+	/**
+	 * Take events sent by players since last call. Call it once per frame, so you don't have to ask every sound
+	 * whether it still plays. Events of each player come in order, events of different players may not.
+	 * @param events cleared and filled with events. Reuse it between calls, so it doesn't allocate.
+	 */
+	void pollEvents( std::vector<SoundEvent>& events );
+
+	/**
+	 * Send MARKER event when sound passes given frame. Looped sound sends it in every loop iteration if marker
+	 * is in loop body. Marker is taken when sound starts, playing sounds keep the old one.
+	 * @param frame frame of sound, -1 removes marker
+	 */
+	void setMarker( const Sound& sound, long long frame );
+
+	/**
+	 * Frame of sound which plays now on its most recently started player. It moves when player finishes
+	 * a buffer, so it is up to one queued chunk behind. Events are sent at the same moments.
+	 * @return frame in sound, wrapped to loop body when looped. -1 if sound has no player (virtual voice too).
+	 */
+	long long getPosition( const Sound& sound ) const;
+
+	/**
+	 * How long play() takes until sound is heard, see LatencyStats. Measured only when library is built with
+	 * KOALA_LATENCY_STATS, otherwise it stays empty. Plays which reached their first callback since last call
+	 * are added to recent plays here. Use LatencyStats::toJson() to dump it.
+	 */
+	const LatencyStats& getLatencyStats();
+	void resetLatencyStats();
+
 	void pauseSound( const Sound& sound );
 	void resumeSound( const Sound& sound );
 	void stopSound( const Sound& sound );
@@ -123,7 +459,172 @@ private:
 	// vector for samples
 	std::vector<ResourceBuffer*> m_samples;
 
-	SLresult initializeBufferQueueAudioPlayer( int maxStreams );
+	OggDecoder m_decoder;
+	size_t m_decodedBudget;
+	int m_maxStreamedVoices;
+	DecodeStats m_decodeStats;
+	VoiceStats m_voiceStats;
+	LatencyStats m_latencyStats;
+	/**
+	 * Decoded loadCompressed() sounds, most recently played first
+	 */
+	std::list<ResourceBuffer*> m_decodedLru;
+
+	/**
+	 * Buffer queue where next update() starts, so all ramps get their turn
+	 */
+	int m_updatePosition;
+
+	struct BatchedPlay
+	{
+		BatchedPlay( const Sound& sound, float volume, bool isLooped, int priority ) :
+			sound( sound )
+			, volume( volume )
+			, isLooped( isLooped )
+			, priority( priority )
+		{
+		}
+
+		Sound sound;
+		float volume;
+		bool isLooped;
+		int priority;
+	};
+
+	/**
+	 * setVolume() or setPan() call, value is volume or pan
+	 */
+	struct BatchedControl
+	{
+		BatchedControl( const Sound& sound, bool isPan, float value, int rampMilliseconds ) :
+			sound( sound )
+			, isPan( isPan )
+			, value( value )
+			, rampMilliseconds( rampMilliseconds )
+		{
+		}
+
+		Sound sound;
+		bool isPan;
+		float value;
+		int rampMilliseconds;
+	};
+
+	/**
+	 * Looped sound which has no player now. Nothing is decoded or updated for it, its position is computed
+	 * from startTime when it gets player again.
+	 */
+	struct VirtualVoice
+	{
+		VirtualVoice( const Sound& sound, float volume, int priority, std::chrono::steady_clock::time_point now ) :
+			sound( sound )
+			, volume( volume )
+			, stereoPosition( 0 )
+			, priority( priority )
+			, channels( 1 )
+			, startTime( now )
+			, isPaused( false )
+			, pauseTime( now )
+		{
+		}
+
+		VirtualVoice( const Sound& sound, const BufferQueue* pVoice, std::chrono::steady_clock::time_point now );
+
+		Sound sound;
+		float volume;
+		SLpermille stereoPosition;
+		int priority;
+		int channels;
+		/**
+		 * When sound would start if it played all the time, pauses excluded
+		 */
+		std::chrono::steady_clock::time_point startTime;
+		bool isPaused;
+		std::chrono::steady_clock::time_point pauseTime;
+	};
+
+	std::vector<VirtualVoice> m_virtualVoices;
+
+	bool m_isBatching;
+	bool m_isBatchStopAll;
+	std::vector<BatchedPlay> m_batchedPlays;
+	std::vector<Sound> m_batchedStops;
+	std::vector<BatchedControl> m_batchedControls;
+	int m_batchMerged;
+	/**
+	 * Id of batch which endBatch() executes now, 0 otherwise
+	 */
+	int m_batchId;
+	int m_batchCounter;
+
+	SLresult initializeBufferQueueAudioPlayer( int maxStreams, int stereoStreams );
+
+	/**
+	 * @param pResumed virtual voice which gets player. It isn't checked against sound limits.
+	 */
+	void startSound( const Sound& sound, float volume, bool isLooped, int priority,
+					 const VirtualVoice* pResumed = nullptr );
+
+	void addVirtualVoice( const VirtualVoice& voice );
+	void resumeVirtualVoices();
+
+	/**
+	 * @param soundId sound whose virtual voices are paused or resumed, 0 for all
+	 */
+	void pauseVirtualVoices( int soundId, bool isPaused );
+
+	/**
+	 * Apply retrigger interval and instance limit of sound.
+	 * @param isResumed virtual voice which gets player again. It was retriggered long ago, but it doesn't
+	 * 			replace instance which plays now. Sound played again while it was virtual.
+	 * @param pInstance voice of the sound which should be reused, nullptr if any voice can be used
+	 * @return false if play must be rejected
+	 */
+	bool checkLimits( const Sound& sound, ResourceBuffer* pResource, int priority,
+					  std::chrono::steady_clock::time_point now, bool isResumed, BufferQueue*& pInstance );
+	void addBatchedPlay( const Sound& sound, float volume, bool isLooped, int priority );
+
+	/**
+	 * Drop collected plays and volume changes of sound
+	 */
+	void removeBatched( int soundId );
+
+	/**
+	 * Convert volume in range [0,1] to level of our players
+	 */
+	SLmillibel toMillibel( float volume ) const;
+
+	Sound addResource( ResourceBuffer* pResource );
+	ResourceBuffer* getResource( const Sound& sound );
+	void setLoopPoints( ResourceBuffer* pResource, int loopStart, int loopLength );
+
+	/**
+	 * Make sure PCM of compressed resource is in memory and mark it as most recently used.
+	 * @return false if it can't be decoded
+	 */
+	bool makeResident( ResourceBuffer* pResource );
+
+	/**
+	 * Drop least recently used decoded sounds until size more bytes fit in budget
+	 */
+	void evictDecoded( size_t size );
+	bool isPlaying( const ResourceBuffer* pResource ) const;
+	int getStreamedVoicesCount() const;
+
+	/**
+	 * @return channels count sound with given channels count must have to be played by this pool. It is
+	 * 			different only if pool has players, but none of them has given channels count.
+	 */
+	int getPlayableChannels( int channels ) const;
+
+	/**
+	 * Downmix or upmix PCM if pool has no player for its channels count.
+	 * @param pPcm PCM allocated with malloc, or with new[] if isNewArray
+	 * @param size size of PCM, updated after conversion
+	 * @param channels channels count of PCM, updated after conversion
+	 * @return converted PCM allocated the same way as pPcm, pPcm is released then. pPcm if nothing changed.
+	 */
+	char* convertToPlayable( char* pPcm, int& size, int& channels, bool isNewArray );
 };
 
 class ResourceBuffer
@@ -132,33 +633,286 @@ public:
 	ResourceBuffer();
 	~ResourceBuffer();
 	char* pBuffer;
+	/**
+	 * Size of PCM. For ADPCM sound size it decodes to.
+	 */
 	int size;
+	/**
+	 * Loop body in bytes of PCM. By default whole buffer.
+	 */
+	int loopOffset;
+	int loopSize;
+	int channels;
+
+	/**
+	 * pBuffer holds IMA-ADPCM sound loaded with SoundPool::loadAdpcm()
+	 */
+	bool isAdpcm;
+
+	/**
+	 * Ogg file of sound loaded with SoundPool::loadCompressed(), nullptr for plain PCM sounds. Then pBuffer
+	 * is decoded PCM (from OggDecoder) or nullptr when it isn't in memory now.
+	 */
+	char* pEncoded;
+	int encodedSize;
+	/**
+	 * Loaded with SoundPool::loadStreamed()
+	 */
+	bool isStreamed;
+	std::list<ResourceBuffer*>::iterator lruPosition;
+
+	/**
+	 * Limits from SoundPool::setSoundLimits(). instances are voices which played it, some of them may play
+	 * something else by now.
+	 */
+	int maxInstances;
+	int minRetriggerMilliseconds;
+	StealPolicy stealPolicy;
+	bool hasPlayed;
+	std::chrono::steady_clock::time_point lastPlayTime;
+	std::vector<BufferQueue*> instances;
+	/**
+	 * Frame from SoundPool::setMarker(), -1 if none
+	 */
+	long long markerFrame;
+
+	inline bool isResident() const
+	{
+		return pBuffer != nullptr;
+	}
+
+	/**
+	 * Free decoded PCM of compressed resource.
+	 */
+	void releaseDecoded();
 };
 
 class BufferQueue
 {
 public:
+	static const unsigned EVENT_QUEUE_SIZE = 16;
+
+	/**
+	 * Event as sent from player callback, SoundPool::pollEvents() makes SoundEvent of it
+	 */
+	struct Event
+	{
+		SoundEventType type;
+		int soundId;
+		int soundPosition;
+		long long frame;
+	};
+
 	BufferQueue();
 	~BufferQueue();
 	SLBufferQueueItf queue;
 	SLObjectItf player;
 	SLPlayItf playerPlay;
 	SLVolumeItf volume;
+	/**
+	 * Channels count of player, set when player is created
+	 */
+	int channels;
+	/**
+	 * Last level set on player. During ramp volume slides from rampFrom to rampTo, otherwise it is rampTo.
+	 */
+	SLmillibel volumeLevel;
+	bool isRamping;
+	float rampFrom;
+	float rampTo;
+	std::chrono::steady_clock::time_point rampStart;
+	int rampMilliseconds;
+	/**
+	 * Stereo position is enabled on first setPan(), it isn't needed before
+	 */
+	bool isStereoPositionEnabled;
+	SLpermille stereoPosition;
+	/**
+	 * Last state set on player
+	 */
+	SLuint32 playState;
+	/**
+	 * Game thread owns voice from acquire() to release(), while it changes what voice plays. Callback which
+	 * comes meanwhile returns at once, see playerCallback().
+	 */
+	std::atomic<bool> isAcquired;
+	std::atomic<bool> isInCallback;
 	/**
 	 * playingSoundId is set to 0 if no sound is playing. If there is other value than 0 it means
-	 * that sound with this ID is played
+	 * that sound with this ID is played. Callback sets it to 0 when sound ends.
 	 */
-	int playingSoundId;
+	std::atomic<int> playingSoundId;
+	/**
+	 * Sound::position of played sound
+	 */
+	int soundPosition;
 	/**
 	 * Priority of currently played audio. Default INT_MIN
 	 */
-	int priority;
+	std::atomic<int> priority;
+	/**
+	 * Batch which started current sound, 0 if it was started by plain play()
+	 */
+	int batchId;
+	/**
+	 * When sound started, moved by pauses. See SoundPool::VirtualVoice.
+	 */
+	std::chrono::steady_clock::time_point startTime;
+	std::chrono::steady_clock::time_point pauseTime;
 	bool isLooped;
-	char* pLastBuffer;
-	int lastSize;
+	/**
+	 * Played resource. Next chunk which will be enqueued starts at position and we enqueue until endPosition.
+	 * When looped we jump back to loop body.
+	 */
+	char* pBuffer;
+	int position;
+	int endPosition;
+	int loopOffset;
+	int loopSize;
+	int frameSize;
+	/**
+	 * Count of buffers waiting in OpenSL queue
+	 */
+	std::atomic<int> queuedBuffers;
+	/**
+	 * Frames in every queued buffer, indexed like chunkBuffers
+	 */
+	std::vector<int> bufferFrames;
+
+	/**
+	 * Frames of current sound which finished playing, counted by callback and read by game thread.
+	 * Sound started at startFrame (see start()), so it is at startFrame + playedFrames, wrapped to loop
+	 * body from loopStartFrame to endFrame. endFrame is end of sound when it isn't looped.
+	 */
+	std::atomic<long long> playedFrames;
+	long long startFrame;
+	long long loopStartFrame;
+	long long endFrame;
+	long long markerFrame;
+	/**
+	 * Written by callback of this player only, read by game thread
+	 */
+	SpscQueue<Event, EVENT_QUEUE_SIZE> events;
+	std::atomic<int> eventsDropped;
+
+	/**
+	 * Play latency, see SoundPool::getLatencyStats(). Times are from LatencyStats::now(). Game thread sets
+	 * times of play and then isFirstCallbackPending, callback takes them and sends PlayTiming.
+	 */
+	LatencyStats* pLatencyStats;
+	std::atomic<long long> requestTime;
+	std::atomic<int> enqueueMicroseconds;
+	std::atomic<bool> isFirstCallbackPending;
+	/**
+	 * 0 until next callback, also after pause or stop, so they don't count as jitter
+	 */
+	std::atomic<long long> lastCallbackTime;
+	SpscQueue<LatencyStats::PlayTiming, 8> playTimings;
+
+	/**
+	 * ADPCM and streamed sounds are decoded to one of chunkBuffers (one per queued buffer) before enqueue.
+	 * They are resized by start() only, while voice is acquired.
+	 */
+	bool isAdpcm;
+	std::vector<char> chunkBuffers;
+	int chunkBufferIndex;
+
+	/**
+	 * Streamed sound is decoded by pStream and we play frames from streamPosition to streamEnd. When looped
+	 * we seek back to streamLoopStart. Decoder is created on first streamed play and reused.
+	 */
+	bool isStreaming;
+	OggStream* pStream;
+	long long streamPosition;
+	long long streamEnd;
+	long long streamLoopStart;
 
 	SLresult realize();
 
+	/**
+	 * @return volume in range [0,1] at given time, during ramp it is somewhere between rampFrom and rampTo
+	 */
+	float getVolume( std::chrono::steady_clock::time_point now ) const;
+
+	/**
+	 * Set state of player, unless it already has it
+	 */
+	SLresult setPlayState( SLuint32 state );
+
+	/**
+	 * Set stereo position on player, unless it already has it. Stereo position is enabled first time.
+	 */
+	SLresult setStereoPosition( SLpermille position );
+
+	/**
+	 * Set level on player, unless it already has it
+	 */
+	SLresult setVolumeLevel( SLmillibel level );
+
+	/**
+	 * Wait until callback leaves voice, callbacks which come later return at once until release(). Buffers
+	 * which finish meanwhile aren't counted, so player should be stopped first or start() called.
+	 */
+	void acquire();
+	void release();
+
+	/**
+	 * Stop player, voice plays nothing afterwards. Voice must be acquired.
+	 */
+	SLresult stop();
+
+	/**
+	 * Stop player, clear queue and start enqueuing given resource. Voice must be acquired, player is
+	 * started by caller after release(). So every play costs SetPlayState to stopped and to playing besides
+	 * its Enqueue calls, only voice stopped by stopSound() skips the first one. Clear is called only when
+	 * buffers are queued, SetVolumeLevel and SetStereoPosition only when level or position change.
+	 * @param isStreamed decode encoded resource on the fly instead of playing its PCM
+	 * @param startFrame how many frames of sound were already played (virtual voice). When looped it is
+	 * 			wrapped to loop body.
+	 */
+	SLresult start( ResourceBuffer* pResource, bool isLooped, bool isStreamed = false, long long startFrame = 0 );
+
+	/**
+	 * Enqueue next chunk of played resource.
+	 * @return SL_RESULT_BUFFER_INSUFFICIENT if there is nothing more to enqueue
+	 */
+	SLresult enqueueNext();
+
+	void startBuffer( ResourceBuffer* pResource, long long startFrame );
+	SLresult openStream( ResourceBuffer* pResource, long long startFrame );
+
+	/**
+	 * Decode next chunk of streamed sound and enqueue it.
+	 */
+	SLresult enqueueDecoded();
+
+	/**
+	 * @return frame of sound which plays after given count of played frames
+	 */
+	long long getFrame( long long played ) const;
+
+	/**
+	 * Count frames of buffer which finished and send events of frames it played. Called by callback.
+	 */
+	void onBufferPlayed( int frames );
+
+	/**
+	 * @return true if marker is at some of frames from begin to end (excluded), counted from start of sound
+	 * 			like startFrame
+	 */
+	bool isMarkerBetween( long long begin, long long end ) const;
+	void sendEvent( SoundEventType type, long long frame );
+
+	/**
+	 * Start measuring latency of sound which was just started. Game thread.
+	 */
+	void measurePlay( std::chrono::steady_clock::time_point request );
+
+	/**
+	 * Measure callback of buffer with given frames. Callback thread.
+	 */
+	void measureCallback( int frames );
+
 	static void playerCallback( SLBufferQueueItf bufferQueue, void* pContext );
 };
 
@@ -0,0 +1,89 @@
+/*
+ * SpscQueue.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+
+#include <atomic>
+
+namespace KoalaSound
+{
+
+/**
+ * Fixed size queue for one producer thread and one consumer thread, e.g. OpenSL callback thread of one
+ * player and game thread. Push and pop never lock or allocate, so producer can be audio callback.
+ * Item is copied in and out, it should be small plain struct.
+ */
+template<typename T, unsigned CAPACITY>
+class SpscQueue
+{
+public:
+	static_assert( CAPACITY > 0 && ( CAPACITY & ( CAPACITY - 1 ) ) == 0, "Capacity must be power of 2" );
+
+	SpscQueue() :
+		m_head( 0 )
+		, m_tail( 0 )
+	{
+	}
+
+	//We want block them
+	SpscQueue( SpscQueue const& ) = delete;
+	void operator= ( SpscQueue const& ) = delete;
+
+	/**
+	 * Producer side.
+	 * @return false if queue is full, item isn't added then
+	 */
+	bool push( const T& item )
+	{
+		const unsigned tail = m_tail.load( std::memory_order_relaxed );
+
+		if( tail - m_head.load( std::memory_order_acquire ) >= CAPACITY )
+		{
+			return false;
+		}
+
+		m_items[tail & ( CAPACITY - 1 )] = item;
+		//Consumer sees item only after it is written
+		m_tail.store( tail + 1, std::memory_order_release );
+		return true;
+	}
+
+	/**
+	 * Consumer side.
+	 * @return false if queue is empty
+	 */
+	bool pop( T& item )
+	{
+		const unsigned head = m_head.load( std::memory_order_relaxed );
+
+		if( head == m_tail.load( std::memory_order_acquire ) )
+		{
+			return false;
+		}
+
+		item = m_items[head & ( CAPACITY - 1 )];
+		//Producer may reuse slot only after it is read
+		m_head.store( head + 1, std::memory_order_release );
+		return true;
+	}
+
+private:
+	/**
+	 * Counters only grow (and wrap), slot is counter & ( CAPACITY - 1 ). Each is written by one thread only,
+	 * padding keeps them on separate cache lines so threads don't fight over them. Queue is allocated
+	 * with its owner, so it can't ask for aligned memory.
+	 */
+	std::atomic<unsigned> m_head;
+	char m_padding[64 - sizeof( std::atomic<unsigned> )];
+	std::atomic<unsigned> m_tail;
+	T m_items[CAPACITY];
+};
+
+} /* namespace KoalaSound */
+
+#endif /* SPSCQUEUE_H_ */
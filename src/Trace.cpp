@@ -0,0 +1,246 @@
+/*
+ * Trace.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <pthread.h>
+
+namespace KoalaSound
+{
+
+namespace
+{
+
+struct EventFormat
+{
+	TraceEvent event;
+	const char* pName;
+	/**
+	 * printf format of 3 values
+	 */
+	const char* pValues;
+};
+
+const EventFormat eventFormats[] =
+{
+	{ TraceEvent::PLAY_REQUEST, "play", "sound:%d priority:%d volume:%d/1000" },
+	{ TraceEvent::PLAY_REJECT_RETRIGGER, "play rejected, retrigger", "sound:%d" },
+	{ TraceEvent::PLAY_REJECT_LIMIT, "play rejected, limit", "sound:%d instances:%d" },
+	{ TraceEvent::PLAY_REUSE_INSTANCE, "reuse instance", "sound:%d priority:%d" },
+	{ TraceEvent::PLAY_CHECK_VOICE, "check voice", "voice:%d priority:%d playing:%d" },
+	{ TraceEvent::PLAY_STEAL, "steal voice", "sound:%d priority:%d by priority:%d" },
+	{ TraceEvent::PLAY_NO_VOICE, "no voice", "sound:%d priority:%d" },
+	{ TraceEvent::PLAY_START, "start", "sound:%d voice:%d level:%dmB" },
+	{ TraceEvent::PLAY_VIRTUALIZE, "virtualize", "sound:%d priority:%d" },
+	{ TraceEvent::PLAY_VIRTUAL_DROP, "drop virtual", "sound:%d priority:%d" },
+	{ TraceEvent::PLAY_VIRTUAL_RESUME, "resume virtual", "sound:%d priority:%d" },
+	{ TraceEvent::CALLBACK_BUFFER, "buffer done", "sound:%d frames:%d queued:%d" },
+	{ TraceEvent::CALLBACK_END, "playing ended", "sound:%d priority:%d" },
+	{ TraceEvent::DECODE_MISS, "decode in play", "sound:%d us:%d" },
+	{ TraceEvent::DECODE_STREAM_FALLBACK, "streamed voices busy", "sound:%d" },
+	{ TraceEvent::CONTROL_PAUSE, "pause", "sound:%d" },
+	{ TraceEvent::CONTROL_RESUME, "resume", "sound:%d" },
+	{ TraceEvent::CONTROL_STOP, "stop", "sound:%d" },
+	{ TraceEvent::CONTROL_PAUSE_ALL, "pause all", "" },
+	{ TraceEvent::CONTROL_RESUME_ALL, "resume all", "" },
+	{ TraceEvent::CONTROL_STOP_ALL, "stop all", "" },
+	{ TraceEvent::CONTROL_BATCH, "batch", "plays:%d merged:%d stops:%d" },
+};
+
+const EventFormat* findFormat( TraceEvent event )
+{
+	for( const EventFormat& format : eventFormats )
+	{
+		if( format.event == event )
+		{
+			return &format;
+		}
+	}
+
+	return nullptr;
+}
+
+#if KOALA_TRACE_CATEGORIES != 0
+
+/**
+ * Written only by owner thread. Record is published by written, reader checks it again after copy.
+ */
+struct Ring
+{
+	std::atomic<uintptr_t> owner;
+	std::atomic<uint32_t> written;
+	TraceRecord records[Trace::RING_RECORDS];
+};
+
+/**
+ * Static, so no thread allocates its ring. Rings are taken from the front and given back only by reset().
+ */
+Ring rings[Trace::MAX_THREADS];
+std::atomic<int> droppedCount( 0 );
+
+int findRing()
+{
+	//Thread id of pthread, not thread_local which may allocate on first use (emulated TLS)
+	const uintptr_t self = ( uintptr_t ) pthread_self();
+
+	for( int i = 0; i < Trace::MAX_THREADS; ++i )
+	{
+		uintptr_t owner = rings[i].owner.load( std::memory_order_relaxed );
+
+		if( owner == self )
+		{
+			return i;
+		}
+
+		//If other thread takes it just now, we try next one
+		if( owner == 0 && rings[i].owner.compare_exchange_strong( owner, self, std::memory_order_relaxed ) )
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+#endif
+
+} /* namespace */
+
+void Trace::write( TraceEvent event, int32_t value0, int32_t value1, int32_t value2 )
+{
+#if KOALA_TRACE_CATEGORIES != 0
+	const int thread = findRing();
+
+	if( thread < 0 )
+	{
+		droppedCount.fetch_add( 1, std::memory_order_relaxed );
+		return;
+	}
+
+	Ring& ring = rings[thread];
+	const uint32_t index = ring.written.load( std::memory_order_relaxed );
+	TraceRecord& record = ring.records[index % RING_RECORDS];
+
+	record.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+							 std::chrono::steady_clock::now().time_since_epoch() ).count();
+	record.event = event;
+	record.thread = thread;
+	record.values[0] = value0;
+	record.values[1] = value1;
+	record.values[2] = value2;
+
+	ring.written.store( index + 1, std::memory_order_release );
+#else
+	( void ) event;
+	( void ) value0;
+	( void ) value1;
+	( void ) value2;
+#endif
+}
+
+void Trace::collect( std::vector<TraceRecord>& records )
+{
+	records.clear();
+
+#if KOALA_TRACE_CATEGORIES != 0
+
+	for( Ring& ring : rings )
+	{
+		if( ring.owner.load( std::memory_order_relaxed ) == 0 )
+		{
+			break;
+		}
+
+		const uint32_t end = ring.written.load( std::memory_order_acquire );
+		const uint32_t begin = end > RING_RECORDS ? end - RING_RECORDS : 0;
+		const size_t copied = records.size();
+
+		for( uint32_t i = begin; i != end; ++i )
+		{
+			records.push_back( ring.records[i % RING_RECORDS] );
+		}
+
+		//Owner went on meanwhile. Slot of its next record holds the oldest one we copied.
+		std::atomic_thread_fence( std::memory_order_acquire );
+		const uint32_t written = ring.written.load( std::memory_order_relaxed );
+		const uint32_t valid = written + 1 > RING_RECORDS ? written + 1 - RING_RECORDS : 0;
+
+		if( valid > begin )
+		{
+			records.erase( records.begin() + copied, records.begin() + copied + std::min( valid, end ) - begin );
+		}
+	}
+
+	std::stable_sort( records.begin(), records.end(), []( const TraceRecord & first, const TraceRecord & second )
+	{
+		return first.nanoseconds < second.nanoseconds;
+	} );
+#endif
+}
+
+std::string Trace::dump()
+{
+	std::vector<TraceRecord> records;
+	collect( records );
+	std::string text;
+
+	for( const TraceRecord& record : records )
+	{
+		text += format( record, records.front().nanoseconds );
+		text += '\n';
+	}
+
+	return text;
+}
+
+std::string Trace::format( const TraceRecord& record, int64_t startNanoseconds )
+{
+	const EventFormat* pFormat = findFormat( record.event );
+	char values[96];
+	snprintf( values, sizeof( values ), pFormat != nullptr ? pFormat->pValues : "%d %d %d", record.values[0],
+			  record.values[1], record.values[2] );
+
+	char text[192];
+	snprintf( text, sizeof( text ), values[0] != '\0' ? "%10.3f ms [%2d] %-24s %s" : "%10.3f ms [%2d] %s",
+			  ( record.nanoseconds - startNanoseconds ) / 1e6, record.thread, getName( record.event ), values );
+	return text;
+}
+
+const char* Trace::getName( TraceEvent event )
+{
+	const EventFormat* pFormat = findFormat( event );
+	return pFormat != nullptr ? pFormat->pName : "unknown";
+}
+
+int Trace::getDroppedCount()
+{
+#if KOALA_TRACE_CATEGORIES != 0
+	return droppedCount.load( std::memory_order_relaxed );
+#else
+	return 0;
+#endif
+}
+
+void Trace::reset()
+{
+#if KOALA_TRACE_CATEGORIES != 0
+
+	for( Ring& ring : rings )
+	{
+		ring.written.store( 0, std::memory_order_relaxed );
+		ring.owner.store( 0, std::memory_order_release );
+	}
+
+	droppedCount.store( 0, std::memory_order_relaxed );
+#endif
+}
+
+} /* namespace KoalaSound */
@@ -0,0 +1,149 @@
+/*
+ * Trace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef TRACE_H_KOALA_SOUND
+#define TRACE_H_KOALA_SOUND
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Categories of KTRACE events. Only categories in KOALA_TRACE_CATEGORIES are compiled in, by default all
+ * of them in DEBUG builds and none otherwise. E.g. -DKOALA_TRACE_CATEGORIES=TRACE_CALLBACK
+ */
+#define TRACE_PLAY 0x01
+#define TRACE_CALLBACK 0x02
+#define TRACE_DECODE 0x04
+#define TRACE_CONTROL 0x08
+#define TRACE_ALL 0xff
+
+#ifndef KOALA_TRACE_CATEGORIES
+#ifdef DEBUG
+#define KOALA_TRACE_CATEGORIES TRACE_ALL
+#else
+#define KOALA_TRACE_CATEGORIES 0
+#endif
+#endif
+
+/**
+ * Record event with up to 3 int values, e.g. KTRACE( PLAY_REQUEST, sound.id, priority ). Unlike KLOG it only
+ * stores few bytes in ring of current thread, it never locks, allocates or calls system, so it is fine on audio
+ * callback thread. Text is made later by Trace::dump(). Events of disabled categories are removed by compiler.
+ */
+#define KTRACE( event, ... ) \
+	do \
+	{ \
+		if( ( KOALA_TRACE_CATEGORIES & KoalaSound::Trace::getCategory( KoalaSound::TraceEvent::event ) ) != 0 ) \
+		{ \
+			KoalaSound::Trace::write( KoalaSound::TraceEvent::event, ##__VA_ARGS__ ); \
+		} \
+	} while( false )
+
+namespace KoalaSound
+{
+
+/**
+ * Category is in high byte. New event needs its name and format in Trace.cpp too.
+ */
+enum class TraceEvent : uint16_t
+{
+	PLAY_REQUEST = TRACE_PLAY << 8,
+	PLAY_REJECT_RETRIGGER,
+	PLAY_REJECT_LIMIT,
+	PLAY_REUSE_INSTANCE,
+	PLAY_CHECK_VOICE,
+	PLAY_STEAL,
+	PLAY_NO_VOICE,
+	PLAY_START,
+	PLAY_VIRTUALIZE,
+	PLAY_VIRTUAL_DROP,
+	PLAY_VIRTUAL_RESUME,
+
+	CALLBACK_BUFFER = TRACE_CALLBACK << 8,
+	CALLBACK_END,
+
+	DECODE_MISS = TRACE_DECODE << 8,
+	DECODE_STREAM_FALLBACK,
+
+	CONTROL_PAUSE = TRACE_CONTROL << 8,
+	CONTROL_RESUME,
+	CONTROL_STOP,
+	CONTROL_PAUSE_ALL,
+	CONTROL_RESUME_ALL,
+	CONTROL_STOP_ALL,
+	CONTROL_BATCH
+};
+
+struct TraceRecord
+{
+	/**
+	 * Steady clock
+	 */
+	int64_t nanoseconds;
+	TraceEvent event;
+	/**
+	 * Ring of thread which wrote it, every thread has its own
+	 */
+	uint16_t thread;
+	int32_t values[3];
+};
+
+class Trace
+{
+public:
+	/**
+	 * Threads which can trace, each gets its ring on first event. Events of threads above it are only
+	 * counted. Every OpenSL player calls back on its own thread, so it is more than players count.
+	 */
+	static const int MAX_THREADS = 40;
+	/**
+	 * Records in ring of every thread, when it is full oldest are overwritten
+	 */
+	static const int RING_RECORDS = 512;
+
+	static constexpr int getCategory( TraceEvent event )
+	{
+		return static_cast<int>( event ) >> 8;
+	}
+
+	static void write( TraceEvent event, int32_t value0 = 0, int32_t value1 = 0, int32_t value2 = 0 );
+
+	/**
+	 * Copy records of all threads, oldest first. Records which were overwritten while we copied them are
+	 * skipped. Don't call it from audio thread.
+	 */
+	static void collect( std::vector<TraceRecord>& records );
+
+	/**
+	 * @return all records as text, one line per record, time in ms from the first one
+	 */
+	static std::string dump();
+
+	/**
+	 * @param startNanoseconds time printed as 0
+	 */
+	static std::string format( const TraceRecord& record, int64_t startNanoseconds );
+
+	static const char* getName( TraceEvent event );
+
+	/**
+	 * @return events lost because there were more than MAX_THREADS threads
+	 */
+	static int getDroppedCount();
+
+	/**
+	 * Forget all records and dropped count. Rings are given back, threads which trace later take them again.
+	 * Otherwise rings of threads which ended stay taken. Don't call it while other threads trace, SoundPool
+	 * calls it when its players are destroyed.
+	 */
+	static void reset();
+};
+
+} /* namespace KoalaSound */
+
+#endif /* TRACE_H_KOALA_SOUND */
@@ -0,0 +1,88 @@
+/*
+ * ChannelMix.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "decoders/ChannelMix.h"
+
+/* Compile time selection like in ImaAdpcm.cpp. Scalar loops handle the tail and builds without SIMD. */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIX_SIMD_NEON
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIX_SIMD_SSE
+#endif
+
+namespace KoalaSound
+{
+
+void ChannelMix::downmix( const short* pStereo, int frames, short* pMono )
+{
+	int i = 0;
+
+#if defined( MIX_SIMD_NEON )
+
+	for( ; i + 8 <= frames; i += 8 )
+	{
+		const int16x8x2_t input = vld2q_s16( pStereo + i * 2 );
+		//Halving add is ( l + r ) >> 1 without overflow, same as scalar code below
+		vst1q_s16( pMono + i, vhaddq_s16( input.val[0], input.val[1] ) );
+	}
+
+#elif defined( MIX_SIMD_SSE )
+	const __m128i ones = _mm_set1_epi16( 1 );
+
+	for( ; i + 8 <= frames; i += 8 )
+	{
+		const __m128i low = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pStereo + i * 2 ) );
+		const __m128i high = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pStereo + i * 2 + 8 ) );
+		//l + r of every frame as 32 bit, halved fits back to 16 bit
+		const __m128i sumLow = _mm_srai_epi32( _mm_madd_epi16( low, ones ), 1 );
+		const __m128i sumHigh = _mm_srai_epi32( _mm_madd_epi16( high, ones ), 1 );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pMono + i ), _mm_packs_epi32( sumLow, sumHigh ) );
+	}
+
+#endif
+
+	for( ; i < frames; ++i )
+	{
+		pMono[i] = static_cast<short>( ( pStereo[i * 2] + pStereo[i * 2 + 1] ) >> 1 );
+	}
+}
+
+void ChannelMix::upmix( const short* pMono, int frames, short* pStereo )
+{
+	int i = 0;
+
+#if defined( MIX_SIMD_NEON )
+
+	for( ; i + 8 <= frames; i += 8 )
+	{
+		int16x8x2_t output;
+		output.val[0] = vld1q_s16( pMono + i );
+		output.val[1] = output.val[0];
+		vst2q_s16( pStereo + i * 2, output );
+	}
+
+#elif defined( MIX_SIMD_SSE )
+
+	for( ; i + 8 <= frames; i += 8 )
+	{
+		const __m128i input = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pMono + i ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pStereo + i * 2 ), _mm_unpacklo_epi16( input, input ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pStereo + i * 2 + 8 ), _mm_unpackhi_epi16( input, input ) );
+	}
+
+#endif
+
+	for( ; i < frames; ++i )
+	{
+		pStereo[i * 2] = pMono[i];
+		pStereo[i * 2 + 1] = pMono[i];
+	}
+}
+
+} /* namespace KoalaSound */
@@ -0,0 +1,40 @@
+/*
+ * ChannelMix.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef CHANNELMIX_H_
+#define CHANNELMIX_H_
+
+namespace KoalaSound
+{
+
+/**
+ * Conversion of 16 bit PCM between mono and stereo. SoundPool uses it at load time for sounds which don't
+ * match any of its players, so nothing is converted while playing.
+ */
+class ChannelMix
+{
+public:
+	/**
+	 * Average left and right channel.
+	 * @param pStereo interleaved stereo PCM
+	 * @param frames count of frames
+	 * @param pMono output, space for frames samples. It must not overlap pStereo.
+	 */
+	static void downmix( const short* pStereo, int frames, short* pMono );
+
+	/**
+	 * Copy mono to both channels.
+	 * @param pMono mono PCM
+	 * @param frames count of frames
+	 * @param pStereo output, space for frames * 2 samples. It must not overlap pMono.
+	 */
+	static void upmix( const short* pMono, int frames, short* pStereo );
+};
+
+} /* namespace KoalaSound */
+
+#endif /* CHANNELMIX_H_ */
@@ -0,0 +1,465 @@
+/*
+ * ImaAdpcm.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "decoders/ImaAdpcm.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "Log.h"
+
+/* Compile time selection like lib/simd.h. Without SIMD blocks are decoded one by one. */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IMA_SIMD_NEON
+
+typedef int32x4_t ima_v4i;
+
+#define v4i_load( p )        vld1q_s32( p )
+#define v4i_store( p, v )    vst1q_s32( ( p ), ( v ) )
+#define v4i_set1( x )        vdupq_n_s32( x )
+#define v4i_add( a, b )      vaddq_s32( ( a ), ( b ) )
+#define v4i_sub( a, b )      vsubq_s32( ( a ), ( b ) )
+#define v4i_and( a, b )      vandq_s32( ( a ), ( b ) )
+#define v4i_xor( a, b )      veorq_s32( ( a ), ( b ) )
+#define v4i_shr( a, n )      vshrq_n_s32( ( a ), ( n ) )
+#define v4i_min( a, b )      vminq_s32( ( a ), ( b ) )
+#define v4i_max( a, b )      vmaxq_s32( ( a ), ( b ) )
+/* all bits set in lanes where a > b */
+#define v4i_gt( a, b )       vreinterpretq_s32_u32( vcgtq_s32( ( a ), ( b ) ) )
+
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMA_SIMD_SSE
+
+typedef __m128i ima_v4i;
+
+#define v4i_load( p )        _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) )
+#define v4i_store( p, v )    _mm_storeu_si128( reinterpret_cast<__m128i*>( p ), ( v ) )
+#define v4i_set1( x )        _mm_set1_epi32( x )
+#define v4i_add( a, b )      _mm_add_epi32( ( a ), ( b ) )
+#define v4i_sub( a, b )      _mm_sub_epi32( ( a ), ( b ) )
+#define v4i_and( a, b )      _mm_and_si128( ( a ), ( b ) )
+#define v4i_xor( a, b )      _mm_xor_si128( ( a ), ( b ) )
+#define v4i_shr( a, n )      _mm_srai_epi32( ( a ), ( n ) )
+#define v4i_gt( a, b )       _mm_cmpgt_epi32( ( a ), ( b ) )
+
+/* SSE2 has no 32 bit min/max */
+static inline __m128i v4i_min( __m128i a, __m128i b )
+{
+	const __m128i mask = _mm_cmpgt_epi32( a, b );
+	return _mm_or_si128( _mm_and_si128( mask, b ), _mm_andnot_si128( mask, a ) );
+}
+
+static inline __m128i v4i_max( __m128i a, __m128i b )
+{
+	const __m128i mask = _mm_cmpgt_epi32( a, b );
+	return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+}
+
+#endif
+
+namespace KoalaSound
+{
+
+static const int STEP_TABLE[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+	107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724,
+	796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026,
+	4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500,
+	20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int INDEX_TABLE[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const char MAGIC[4] = { 'K', 'I', 'M', 'A' };
+static const int VERSION = 1;
+
+static void writeInt( unsigned char* pData, int value, int bytes )
+{
+	for( int i = 0; i < bytes; ++i )
+	{
+		pData[i] = static_cast<unsigned char>( value >> ( 8 * i ) );
+	}
+}
+
+static int readInt( const unsigned char* pData, int bytes )
+{
+	unsigned int value = 0;
+
+	for( int i = bytes - 1; i >= 0; --i )
+	{
+		value = ( value << 8 ) | pData[i];
+	}
+
+	return static_cast<int>( value );
+}
+
+static inline int clampSample( int value )
+{
+	return std::min( 32767, std::max( -32768, value ) );
+}
+
+static inline int clampIndex( int index )
+{
+	return std::min( 88, std::max( 0, index ) );
+}
+
+/**
+ * Reference decoder of one sample. Encoder uses the same math so they never drift apart.
+ */
+static inline void decodeNibble( int nibble, int& predictor, int& index )
+{
+	const int step = STEP_TABLE[index];
+	int difference = step >> 3;
+
+	if( nibble & 4 )
+	{
+		difference += step;
+	}
+
+	if( nibble & 2 )
+	{
+		difference += step >> 1;
+	}
+
+	if( nibble & 1 )
+	{
+		difference += step >> 2;
+	}
+
+	predictor = clampSample( nibble & 8 ? predictor - difference : predictor + difference );
+	index = clampIndex( index + INDEX_TABLE[nibble & 7] );
+}
+
+static inline int encodeSample( int sample, int& predictor, int& index )
+{
+	int step = STEP_TABLE[index];
+	int difference = sample - predictor;
+	int nibble = 0;
+
+	if( difference < 0 )
+	{
+		nibble = 8;
+		difference = -difference;
+	}
+
+	if( difference >= step )
+	{
+		nibble |= 4;
+		difference -= step;
+	}
+
+	step >>= 1;
+
+	if( difference >= step )
+	{
+		nibble |= 2;
+		difference -= step;
+	}
+
+	step >>= 1;
+
+	if( difference >= step )
+	{
+		nibble |= 1;
+	}
+
+	decodeNibble( nibble, predictor, index );
+	return nibble;
+}
+
+/**
+ * @param pPcm first sample of block in interleaved PCM
+ * @param frames frames left in sound, block is padded with last sample when there are less than BLOCK_FRAMES
+ * @param index step index carried from previous block of this channel
+ */
+static void encodeBlock( const short* pPcm, int channels, int frames, int& index, unsigned char* pBlock )
+{
+	int predictor = pPcm[0];
+	writeInt( pBlock, predictor, 2 );
+	pBlock[2] = static_cast<unsigned char>( index );
+	pBlock[3] = 0;
+
+	unsigned char* pNibbles = pBlock + 4;
+	memset( pNibbles, 0, ImaAdpcm::BLOCK_BYTES - 4 );
+
+	for( int i = 1; i < ImaAdpcm::BLOCK_FRAMES; ++i )
+	{
+		const int sample = pPcm[std::min( i, frames - 1 ) * channels];
+		const int nibble = encodeSample( sample, predictor, index );
+		pNibbles[( i - 1 ) >> 1] |= ( i - 1 ) & 1 ? nibble << 4 : nibble;
+	}
+}
+
+static void decodeBlock( const unsigned char* pBlock, short* pOutput, int stride )
+{
+	int predictor = static_cast<short>( readInt( pBlock, 2 ) );
+	int index = clampIndex( pBlock[2] );
+	const unsigned char* pNibbles = pBlock + 4;
+
+	pOutput[0] = predictor;
+
+	for( int i = 0; i < ImaAdpcm::BLOCK_BYTES - 4; ++i )
+	{
+		decodeNibble( pNibbles[i] & 15, predictor, index );
+		pOutput[( 2 * i + 1 ) * stride] = predictor;
+		decodeNibble( pNibbles[i] >> 4, predictor, index );
+		pOutput[( 2 * i + 2 ) * stride] = predictor;
+	}
+}
+
+#if defined( IMA_SIMD_NEON ) || defined( IMA_SIMD_SSE )
+
+/**
+ * Decode 4 independent blocks in lockstep, one per vector lane. Only step table lookup is done per lane.
+ */
+static void decodeBlocks4( const unsigned char* const pBlocks[4], short* const pOutputs[4], int stride )
+{
+	int predictors[4];
+	int indexes[4];
+
+	for( int lane = 0; lane < 4; ++lane )
+	{
+		predictors[lane] = static_cast<short>( readInt( pBlocks[lane], 2 ) );
+		indexes[lane] = clampIndex( pBlocks[lane][2] );
+		pOutputs[lane][0] = predictors[lane];
+	}
+
+	ima_v4i predictor = v4i_load( predictors );
+	ima_v4i index = v4i_load( indexes );
+
+	const ima_v4i zero = v4i_set1( 0 );
+	const ima_v4i one = v4i_set1( 1 );
+	const ima_v4i two = v4i_set1( 2 );
+	const ima_v4i three = v4i_set1( 3 );
+	const ima_v4i four = v4i_set1( 4 );
+	const ima_v4i seven = v4i_set1( 7 );
+	const ima_v4i fifteen = v4i_set1( 15 );
+	const ima_v4i maxIndex = v4i_set1( 88 );
+	const ima_v4i minSample = v4i_set1( -32768 );
+	const ima_v4i maxSample = v4i_set1( 32767 );
+
+	int words[4];
+	int steps[4];
+	int samples[4];
+
+	/* 4 bytes (8 samples) of every block per iteration */
+	for( int i = 0; i < ImaAdpcm::BLOCK_BYTES - 4; i += 4 )
+	{
+		for( int lane = 0; lane < 4; ++lane )
+		{
+			words[lane] = readInt( pBlocks[lane] + 4 + i, 4 );
+		}
+
+		ima_v4i word = v4i_load( words );
+
+		for( int k = 0; k < 8; ++k )
+		{
+			const ima_v4i nibble = v4i_and( word, fifteen );
+			word = v4i_shr( word, 4 );
+
+			v4i_store( indexes, index );
+
+			for( int lane = 0; lane < 4; ++lane )
+			{
+				steps[lane] = STEP_TABLE[indexes[lane]];
+			}
+
+			const ima_v4i step = v4i_load( steps );
+
+			/* difference = step/8 + bits of nibble selecting step, step/2 and step/4 */
+			ima_v4i difference = v4i_shr( step, 3 );
+			difference = v4i_add( difference, v4i_and( v4i_gt( v4i_and( nibble, four ), zero ), step ) );
+			difference = v4i_add( difference, v4i_and( v4i_gt( v4i_and( nibble, two ), zero ), v4i_shr( step, 1 ) ) );
+			difference = v4i_add( difference, v4i_and( v4i_gt( v4i_and( nibble, one ), zero ), v4i_shr( step, 2 ) ) );
+
+			/* bit 3 is sign: -x == ( x ^ -1 ) + 1 */
+			const ima_v4i sign = v4i_gt( nibble, seven );
+			difference = v4i_sub( v4i_xor( difference, sign ), sign );
+
+			predictor = v4i_min( maxSample, v4i_max( minSample, v4i_add( predictor, difference ) ) );
+
+			/* INDEX_TABLE: -1 for magnitude 0..3, ( magnitude - 3 ) * 2 for 4..7 */
+			const ima_v4i magnitude = v4i_sub( v4i_and( nibble, seven ), three );
+			const ima_v4i isBig = v4i_gt( magnitude, zero );
+			const ima_v4i adjust = v4i_sub( v4i_and( isBig, v4i_add( v4i_add( magnitude, magnitude ), one ) ), one );
+			index = v4i_min( maxIndex, v4i_max( zero, v4i_add( index, adjust ) ) );
+
+			v4i_store( samples, predictor );
+			const int position = ( 2 * i + 1 + k ) * stride;
+
+			for( int lane = 0; lane < 4; ++lane )
+			{
+				pOutputs[lane][position] = samples[lane];
+			}
+		}
+	}
+}
+
+#else
+
+static void decodeBlocks4( const unsigned char* const pBlocks[4], short* const pOutputs[4], int stride )
+{
+	for( int lane = 0; lane < 4; ++lane )
+	{
+		decodeBlock( pBlocks[lane], pOutputs[lane], stride );
+	}
+}
+
+#endif
+
+bool ImaAdpcm::encode( const Data& pcm, std::vector<char>& output )
+{
+	if( pcm.pData == nullptr || pcm.channelsCount < 1 || pcm.channelsCount > MAX_CHANNELS )
+	{
+		KLOG( "Can't encode %d channel sound to IMA-ADPCM", pcm.channelsCount );
+		return false;
+	}
+
+	const int channels = pcm.channelsCount;
+	const int frames = pcm.size / ( 2 * channels );
+	const int groups = ( frames + BLOCK_FRAMES - 1 ) / BLOCK_FRAMES;
+
+	if( frames < 1 )
+	{
+		KLOG( "Nothing to encode" );
+		return false;
+	}
+
+	output.assign( HEADER_BYTES + groups * channels * BLOCK_BYTES, 0 );
+	unsigned char* pOutput = reinterpret_cast<unsigned char*>( output.data() );
+
+	memcpy( pOutput, MAGIC, sizeof( MAGIC ) );
+	pOutput[4] = VERSION;
+	pOutput[5] = channels;
+	writeInt( pOutput + 8, pcm.bitrate, 4 );
+	writeInt( pOutput + 12, frames, 4 );
+	writeInt( pOutput + 16, pcm.loopStart, 4 );
+	writeInt( pOutput + 20, pcm.loopLength, 4 );
+
+	const short* pSamples = reinterpret_cast<const short*>( pcm.pData );
+	int indexes[MAX_CHANNELS] = {};
+	unsigned char* pBlock = pOutput + HEADER_BYTES;
+
+	for( int group = 0; group < groups; ++group )
+	{
+		const int frame = group * BLOCK_FRAMES;
+
+		for( int channel = 0; channel < channels; ++channel )
+		{
+			encodeBlock( pSamples + frame * channels + channel, channels, frames - frame, indexes[channel], pBlock );
+			pBlock += BLOCK_BYTES;
+		}
+	}
+
+	return true;
+}
+
+bool ImaAdpcm::readInfo( const char* pData, size_t size, Info& info )
+{
+	const unsigned char* pHeader = reinterpret_cast<const unsigned char*>( pData );
+
+	if( pData == nullptr || size < static_cast<size_t>( HEADER_BYTES ) || memcmp( pHeader, MAGIC, sizeof( MAGIC ) ) != 0 )
+	{
+		KLOG( "This isn't IMA-ADPCM sound" );
+		return false;
+	}
+
+	if( pHeader[4] != VERSION )
+	{
+		KLOG( "Unsupported IMA-ADPCM version %d", pHeader[4] );
+		return false;
+	}
+
+	info.channels = pHeader[5];
+	info.rate = readInt( pHeader + 8, 4 );
+	info.frames = readInt( pHeader + 12, 4 );
+	info.loopStart = readInt( pHeader + 16, 4 );
+	info.loopLength = readInt( pHeader + 20, 4 );
+
+	if( info.channels < 1 || info.channels > MAX_CHANNELS || info.frames < 1 )
+	{
+		KLOG( "Corrupt IMA-ADPCM header" );
+		return false;
+	}
+
+	const size_t groups = ( info.frames + BLOCK_FRAMES - 1 ) / BLOCK_FRAMES;
+
+	if( size < HEADER_BYTES + groups * info.channels * BLOCK_BYTES )
+	{
+		KLOG( "IMA-ADPCM sound is truncated" );
+		return false;
+	}
+
+	return true;
+}
+
+void ImaAdpcm::decode( const char* pData, int firstFrame, int frames, short* pOutput )
+{
+	const unsigned char* pBytes = reinterpret_cast<const unsigned char*>( pData );
+	const int channels = pBytes[5];
+	const unsigned char* pGroups = pBytes + HEADER_BYTES;
+
+	assert( channels >= 1 && channels <= MAX_CHANNELS );
+	assert( firstFrame >= 0 && frames >= 0 );
+
+	//Whole blocks waiting for SIMD decoder
+	const unsigned char* pBlocks[4];
+	short* pOutputs[4];
+	int pending = 0;
+
+	const int end = firstFrame + frames;
+	int frame = firstFrame;
+
+	while( frame < end )
+	{
+		const int group = frame / BLOCK_FRAMES;
+		const int groupStart = group * BLOCK_FRAMES;
+		const unsigned char* pGroup = pGroups + group * channels * BLOCK_BYTES;
+		short* pGroupOutput = pOutput + ( frame - firstFrame ) * channels;
+
+		if( frame == groupStart && end - frame >= BLOCK_FRAMES )
+		{
+			for( int channel = 0; channel < channels; ++channel )
+			{
+				pBlocks[pending] = pGroup + channel * BLOCK_BYTES;
+				pOutputs[pending] = pGroupOutput + channel;
+
+				if( ++pending == 4 )
+				{
+					decodeBlocks4( pBlocks, pOutputs, channels );
+					pending = 0;
+				}
+			}
+
+			frame += BLOCK_FRAMES;
+			continue;
+		}
+
+		//Range starts or ends inside this group, decode it aside and copy the part we want
+		short scratch[BLOCK_FRAMES * MAX_CHANNELS];
+
+		for( int channel = 0; channel < channels; ++channel )
+		{
+			decodeBlock( pGroup + channel * BLOCK_BYTES, scratch + channel, channels );
+		}
+
+		const int count = std::min( end, groupStart + BLOCK_FRAMES ) - frame;
+		memcpy( pGroupOutput, scratch + ( frame - groupStart ) * channels, count * channels * sizeof( short ) );
+		frame += count;
+	}
+
+	for( int i = 0; i < pending; ++i )
+	{
+		decodeBlock( pBlocks[i], pOutputs[i], channels );
+	}
+}
+
+} /* namespace KoalaSound */
@@ -0,0 +1,73 @@
+/*
+ * ImaAdpcm.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef IMAADPCM_H_
+#define IMAADPCM_H_
+
+#include <vector>
+
+#include "decoders/OggDecoder.h"
+
+namespace KoalaSound
+{
+
+/**
+ * IMA-ADPCM sounds. 4 bits per sample, 4x smaller than 16 bit PCM and decoding is only few integer operations
+ * per sample, so it can be kept in memory and decoded while playing.
+ *
+ * Layout (little endian):
+ *  - header, HEADER_BYTES: "KIMA", version, channels, 2 reserved bytes, rate, frames, loop start, loop length
+ *  - groups of blocks. Group has one block per channel and holds BLOCK_FRAMES frames. Block is the usual
+ *    IMA block: first sample (int16), step index (uint8), reserved byte and 2 * (BLOCK_BYTES - 4) samples
+ *    as nibbles, low nibble first. Last group is padded.
+ *
+ * Every block starts from its own header so blocks can be decoded in any order and side by side.
+ */
+class ImaAdpcm
+{
+public:
+	static const int HEADER_BYTES = 24;
+	static const int BLOCK_BYTES = 256;
+	static const int BLOCK_FRAMES = 1 + 2 * ( BLOCK_BYTES - 4 );
+	static const int MAX_CHANNELS = 2;
+
+	struct Info
+	{
+		int channels;
+		int rate;
+		int frames;
+		int loopStart;
+		int loopLength;
+	};
+
+	/**
+	 * Encode PCM, e.g. from OggDecoder::decode. Loop points are kept.
+	 * @param pcm interleaved 16 bit PCM, mono or stereo
+	 * @param output encoded sound is written here
+	 * @return true if everything is ok, false otherwise
+	 */
+	static bool encode( const Data& pcm, std::vector<char>& output );
+
+	/**
+	 * Check header and size of encoded sound.
+	 * @return true if pData holds whole valid sound
+	 */
+	static bool readInfo( const char* pData, size_t size, Info& info );
+
+	/**
+	 * Decode range of frames. Whole blocks inside the range are decoded straight to output, 4 at once.
+	 * @param pData encoded sound, checked with readInfo
+	 * @param firstFrame first frame to decode
+	 * @param frames count of frames, firstFrame + frames must not exceed Info::frames
+	 * @param pOutput interleaved 16 bit PCM, space for frames * channels samples
+	 */
+	static void decode( const char* pData, int firstFrame, int frames, short* pOutput );
+};
+
+} /* namespace KoalaSound */
+
+#endif /* IMAADPCM_H_ */
@@ -7,393 +7,735 @@
 
 #include "decoders/OggDecoder.h"
 
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
 #include <vorbis/vorbisfile.h>
 
+#include "decoders/VorbisSetupCache.h"
+
 namespace KoalaSound
 {
 
+const char* const OggDecoder::SHARED_SETUP_TAG = "KOALA_SETUP";
+
+/**
+ * Headers of one link. Cleared however we leave decodeLink().
+ */
+struct VorbisHeaders
+{
+	VorbisHeaders()
+	{
+		vorbis_info_init( &info );
+		vorbis_comment_init( &comment );
+	}
+
+	~VorbisHeaders()
+	{
+		vorbis_comment_clear( &comment );
+		vorbis_info_clear( &info );  /* must be called last */
+	}
+
+	//We want block them
+	VorbisHeaders( VorbisHeaders const& ) = delete;
+	void operator= ( VorbisHeaders const& ) = delete;
+
+	vorbis_info info; /* struct that stores all the static vorbis bitstream settings */
+	vorbis_comment comment; /* struct that stores all the bitstream user comments */
+};
+
+/**
+ * Packet->PCM decoder state of one link.
+ */
+struct VorbisSynthesis
+{
+	explicit VorbisSynthesis( vorbis_info* pInfo ) :
+		isReady( vorbis_synthesis_init( &dsp, pInfo ) == 0 )
+	{
+		if( isReady )
+		{
+			vorbis_block_init( &dsp, &block );
+		}
+	}
+
+	~VorbisSynthesis()
+	{
+		if( isReady )
+		{
+			vorbis_block_clear( &block );
+			vorbis_dsp_clear( &dsp );
+		}
+	}
+
+	//We want block them
+	VorbisSynthesis( VorbisSynthesis const& ) = delete;
+	void operator= ( VorbisSynthesis const& ) = delete;
+
+	const bool isReady;
+	vorbis_dsp_state dsp; /* central working state for the packet->PCM decoder */
+	vorbis_block block; /* local working space for packet->PCM decode */
+};
+
 OggDecoder::OggDecoder() :
-	m_convertBufferSize( 4096 )
-	, m_convertBuffer( new ogg_int16_t[m_convertBufferSize] )
+	m_pInput( nullptr )
+	, m_inputSize( 0 )
+	, m_inputPosition( 0 )
+	, m_pOutput( nullptr )
+	, m_outputSize( 0 )
+	, m_outputCapacity( 0 )
 {
 	static_assert( sizeof( unsigned short ) == 2, "Wrong size!" );
 	static_assert( sizeof( signed int ) == 4, "Wrong size!" );
 	static_assert( sizeof( unsigned int ) == 4, "Wrong size!" );
 	static_assert( sizeof( long long int ) == 8, "Wrong size!" );
+
+	//Both are reused by every decode() call, they keep their buffers
+	ogg_sync_init( &m_sync );
+	ogg_stream_init( &m_stream, 0 );
 }
 
 OggDecoder::~OggDecoder()
 {
-	delete[] m_convertBuffer;
+	ogg_stream_clear( &m_stream );
+	ogg_sync_clear( &m_sync );
 }
 
 Data OggDecoder::decode( const char* pData, size_t size )
 {
 	/*
-	 * This source code is from: http://svn.xiph.org/trunk/vorbis/examples/decoder_example.c
-	 * Little bit modified for reading and writing data from buffers also refactored.
+	 * Based on: http://svn.xiph.org/trunk/vorbis/examples/decoder_example.c
+	 * Reads straight from the buffer. All ogg/vorbis state is either owned by this object and reused
+	 * or scoped to one link, so error paths don't leak.
 	 */
-	ogg_sync_state   oy; /* sync and verify incoming physical bitstream */
-	ogg_stream_state os; /* take physical pages, weld into a logical
-	                          stream of packets */
-	ogg_page         og; /* one Ogg bitstream page. Vorbis packets are inside */
-	ogg_packet       op; /* one raw packet of data for decode */
-
-	vorbis_info      vi; /* struct that stores all the static vorbis bitstream
-	                          settings */
-	vorbis_comment   vc; /* struct that stores all the bitstream user comments */
-	vorbis_dsp_state vd; /* central working state for the packet->PCM decoder */
-	vorbis_block     vb; /* local working space for packet->PCM decode */
+	ogg_sync_reset( &m_sync );
+	m_pInput = pData;
+	m_inputSize = pData == nullptr ? 0 : size;
+	m_inputPosition = 0;
+	m_pOutput = nullptr;
+	m_outputSize = 0;
+	m_outputCapacity = 0;
 
 	Data outputData;//Out output data
+	ogg_page page;
 
-	std::stringstream encodedStream;
-	encodedStream.write( pData, size );  //write our encoded data to stream.
-	encodedStream.seekg( 0, encodedStream.beg );
-
-	std::stringstream decodedStream;
+	/* we repeat if the bitstream is chained */
+	while( readPage( &page ) )
+	{
+		if( ogg_page_bos( &page ) == 0 )
+		{
+			if( outputData.channelsCount == 0 )
+			{
+				/* error case.  Must not be Vorbis data */
+				KLOG( "Input does not appear to be an Ogg bitstream.\n" );
+				assert( false );
+				m_pInput = nullptr;
+				delete[] m_pOutput;
+				return Data();
+			}
 
-	char* buffer;
-	int  bytes;
+			//Rest of link we couldn't decode
+			continue;
+		}
 
-	/********** Decode setup ************/
+		if( decodeLink( &page, outputData ) == false )
+		{
+			assert( false );
+			m_pInput = nullptr;
+			delete[] m_pOutput;
+			return Data();
+		}
+	}
 
-	ogg_sync_init( &oy );  /* Now we can read pages */
+	m_pInput = nullptr;
 
-	const int block4k = 4096;
-	int convsize = block4k;
+	if( m_outputSize < 1 )
+	{
+		KLOG( "Problems with decoded stream!" );
+		assert( false );
+		delete[] m_pOutput;
+		return Data();
+	}
 
-	while( 1 )  /* we repeat if the bitstream is chained */
+	if( m_outputCapacity - m_outputSize > m_outputSize / 4 )
 	{
-		int eos = 0;
-		int i;
+		//Estimate was far off (file is cut, or starts at granule > 0 and first page is short blocks), don't keep
+		//so much unused memory
+		KLOG( "Decoded %d bytes into %d bytes buffer, shrinking", static_cast<int>( m_outputSize ),
+			  static_cast<int>( m_outputCapacity ) );
+		char* pOutput = new char[m_outputSize];
+		memcpy( pOutput, m_pOutput, m_outputSize );
+		delete[] m_pOutput;
+		m_pOutput = pOutput;
+	}
+
+	outputData.pData = m_pOutput;
+	outputData.size = m_outputSize;
+	m_pOutput = nullptr;
 
-		/* grab some data at the head of the stream. We want the first page
-		   (which is guaranteed to be small and only contain the Vorbis
-		   stream initial header) We need the first page to get the stream
-		   serialno. */
+	KLOG( "Done.\n" );
 
+	return outputData;
+}
 
-		/* submit a 4k block to libvorbis' Ogg layer */
-		buffer = ogg_sync_buffer( &oy, block4k );
+bool OggDecoder::readPage( ogg_page* pPage )
+{
+	const int block4k = 4096;
 
-		encodedStream.read( buffer, block4k );
-		bytes = encodedStream.gcount();
+	while( 1 )
+	{
+		const int result = ogg_sync_pageout( &m_sync, pPage );
 
-		ogg_sync_wrote( &oy, bytes );
+		if( result == 1 )
+		{
+			return true;
+		}
 
-		/* Get the first page. */
-		if( ogg_sync_pageout( &oy, &og ) != 1 )
+		if( result < 0 )
 		{
-			/* have we simply run out of data?  If so, we're done. */
-			if( bytes < block4k ) { break; }
+			/* missing or corrupt data at this page position. Don't complain for header pages,
+			   we will catch it at the packet output phase */
+			KLOG( "Corrupt or missing data in bitstream;\ncontinuing...\n" );
+			continue;
+		}
 
-			/* error case.  Must not be Vorbis data */
-			KLOG( "Input does not appear to be an Ogg bitstream.\n" );
-			assert( false );
-			return Data();
+		/* need more data */
+		const size_t bytes = std::min<size_t>( block4k, m_inputSize - m_inputPosition );
+
+		if( bytes == 0 )
+		{
+			return false;
 		}
 
-		/* Get the serial number and set up the rest of decode. */
-		/* serialno first; use it to set up a logical stream */
-		ogg_stream_init( &os, ogg_page_serialno( &og ) );
+		char* pBuffer = ogg_sync_buffer( &m_sync, bytes );
+		memcpy( pBuffer, m_pInput + m_inputPosition, bytes );
+		m_inputPosition += bytes;
+		ogg_sync_wrote( &m_sync, bytes );
+	}
+}
 
-		/* extract the initial header from the first page and verify that the
-		   Ogg bitstream is in fact Vorbis data */
+bool OggDecoder::decodeLink( ogg_page* pFirstPage, Data& output )
+{
+	ogg_page page;
+	ogg_packet packet;
+	VorbisHeaders headers;
 
-		/* I handle the initial header first instead of just having the code
-		   read all three Vorbis headers at once because reading the initial
-		   header is an easy way to identify a Vorbis bitstream and it's
-		   useful to see that functionality seperated out. */
+	/* Get the serial number and set up the rest of decode. */
+	ogg_stream_reset_serialno( &m_stream, ogg_page_serialno( pFirstPage ) );
 
-		vorbis_info_init( &vi );
-		vorbis_comment_init( &vc );
+	/* extract the initial header from the first page and verify that the
+	   Ogg bitstream is in fact Vorbis data */
+	if( ogg_stream_pagein( &m_stream, pFirstPage ) < 0 )
+	{
+		/* error; stream version mismatch perhaps */
+		KLOG( "Error reading first page of Ogg bitstream data.\n" );
+		return false;
+	}
 
-		if( ogg_stream_pagein( &os, &og ) < 0 )
+	if( ogg_stream_packetout( &m_stream, &packet ) != 1 )
+	{
+		/* no page? must not be vorbis */
+		KLOG( "Error reading initial header packet.\n" );
+		return false;
+	}
+
+	if( vorbis_synthesis_headerin( &headers.info, &headers.comment, &packet ) < 0 )
+	{
+		/* error case; not a vorbis header */
+		KLOG( "This Ogg bitstream does not contain Vorbis audio data.\n" );
+		return false;
+	}
+
+	const bool isFirstLink = output.channelsCount == 0;
+
+	if( isFirstLink == false && ( headers.info.channels != output.channelsCount ||
+								  headers.info.rate != output.bitrate ) )
+	{
+		//Output has one format. We could resample/remix but chained assets with other format are authoring bugs.
+		KLOG( "Skipping chained link with other format: %d channel, %ldHz", headers.info.channels, headers.info.rate );
+		return true;
+	}
+
+	/* packet data lives in ogg_stream_state and will be overwritten. Setup cache needs
+	   identification header together with setup header */
+	std::vector<unsigned char> identification( packet.packet, packet.packet + packet.bytes );
+	std::shared_ptr<vorbis_info> pInfo;
+
+	/* The next two packets in order are the comment and codebook headers.
+	   They're likely large and may span multiple pages. Thus we read
+	   and submit data until we get our two packets, watching that no
+	   pages are missing. If a page is missing, error out; losing a
+	   header page is the only place where missing data is fatal. */
+	int headersCount = 1;
+	bool isEnd = false;
+
+	while( headersCount < 3 )
+	{
+		if( headersCount == 2 && isAudioPacketNext( &m_stream ) )
 		{
-			/* error; stream version mismatch perhaps */
-			KLOG( "Error reading first page of Ogg bitstream data.\n" );
-			assert( false );
-			return Data();
+			/* Setup header was left out by encoder. Audio packet stays in
+			   stream state and is decoded first below. */
+			pInfo = acquireSharedSetup( identification, &headers.comment );
+
+			if( pInfo == nullptr )
+			{
+				return false;
+			}
+
+			break;
 		}
 
-		if( ogg_stream_packetout( &os, &op ) != 1 )
+		const int result = ogg_stream_packetout( &m_stream, &packet );
+
+		if( result < 0 )
 		{
-			/* no page? must not be vorbis */
-			KLOG( "Error reading initial header packet.\n" );
-			assert( false );
-			return Data();
+			/* Uh oh; data at some point was corrupted or missing!
+			   We can't tolerate that in a header.  Die. */
+			KLOG( "Corrupt secondary header.  Exiting.\n" );
+			return false;
 		}
 
-		if( vorbis_synthesis_headerin( &vi, &vc, &op ) < 0 )
+		if( result == 0 )
 		{
-			/* error case; not a vorbis header */
-			KLOG( "This Ogg bitstream does not contain Vorbis audio data.\n" );
-			assert( false );
-			return Data();
+			if( isEnd || readPage( &page ) == false )
+			{
+				KLOG( "End of file before finding all Vorbis headers!\n" );
+				return false;
+			}
+
+			ogg_stream_pagein( &m_stream, &page ); /* we can ignore any errors here
+	                                         as they'll also become apparent
+	                                         at packetout */
+
+			/* stream without setup header can end on its first audio page */
+			isEnd = ogg_page_eos( &page ) != 0;
+			continue;
 		}
 
-		/* At this point, we're sure we're Vorbis. We've set up the logical
-		   (Ogg) bitstream decoder. Get the comment and codebook headers and
-		   set up the Vorbis decoder */
+		if( headersCount == 1 )
+		{
+			if( vorbis_synthesis_headerin( &headers.info, &headers.comment, &packet ) < 0 )
+			{
+				KLOG( "Corrupt secondary header.  Exiting.\n" );
+				return false;
+			}
+		}
+		else
+		{
+			/* setup header; parsed codebooks are shared between all decoders */
+			pInfo = VorbisSetupCache::getInstance().acquire( identification, &packet, &headers.comment );
 
-		/* The next two packets in order are the comment and codebook headers.
-		   They're likely large and may span multiple pages. Thus we read
-		   and submit data until we get our two packets, watching that no
-		   pages are missing. If a page is missing, error out; losing a
-		   header page is the only place where missing data is fatal. */
+			if( pInfo == nullptr )
+			{
+				KLOG( "Corrupt secondary header.  Exiting.\n" );
+				return false;
+			}
+		}
 
-		i = 0;
+		++headersCount;
+	}
+
+	/* Throw the comments plus a few lines about the bitstream we're
+	   decoding */
+	for( char** ptr = headers.comment.user_comments; *ptr != nullptr; ++ptr )
+	{
+		KLOG( "%s\n", *ptr );
+	}
 
-		while( i < 2 )
+	KLOG( "\nBitstream is %d channel, %ldHz\n", headers.info.channels, headers.info.rate );
+	KLOG( "Encoded by: %s\n\n", headers.comment.vendor );
+
+	if( isFirstLink )
+	{
+		output.bitrate = headers.info.rate;
+		output.channelsCount = headers.info.channels;
+
+		//Loop points of chained streams are taken from first link only
+		readLoopPoints( &headers.comment, output.loopStart, output.loopLength );
+
+		const long long frames = findTotalFrames( vorbis_info_blocksize( pInfo.get(), 1 ) / 2 );
+		const long long bytes = frames * 2 * headers.info.channels;
+		//Vorbis at its lowest bitrates is ~1:45 of 16 bit PCM. Only silence compresses more, its output grows.
+		const long long maxCompression = 64;
+
+		//Granule of damaged last page can be anything, then we rather grow output as we decode
+		if( frames > 0 && bytes <= static_cast<long long>( m_inputSize ) * maxCompression &&
+				static_cast<unsigned long long>( bytes ) <= std::numeric_limits<size_t>::max() )
 		{
-			while( i < 2 )
-			{
-				int result = ogg_sync_pageout( &oy, &og );
+			//Whole output in one allocation, decodePackets writes straight into it
+			assert( m_pOutput == nullptr );
+			m_outputCapacity = static_cast<size_t>( bytes );
+			m_pOutput = new char[m_outputCapacity];
+		}
+	}
 
-				if( result == 0 ) { break; }  /* Need more data */
+	/* OK, got and parsed all three headers. Initialize the Vorbis
+	   packet->PCM decoder. */
+	VorbisSynthesis synthesis( pInfo.get() );
 
-				/* Don't complain about missing or corrupt data yet. We'll
-				   catch it at the packet output phase */
-				if( result == 1 )
-				{
-					ogg_stream_pagein( &os, &og ); /* we can ignore any errors here
-	                                         as they'll also become apparent
-	                                         at packetout */
+	if( synthesis.isReady == false )
+	{
+		//Not fatal, pages of this link are dropped by decode()
+		KLOG( "Error: Corrupt header during playback initialization.\n" );
+		return true;
+	}
 
-					while( i < 2 )
-					{
-						result = ogg_stream_packetout( &os, &op );
+	/* Packets already in stream state. Only streams without setup header have them here. */
+	decodePackets( &m_stream, &synthesis.dsp, &synthesis.block, headers.info.channels );
+
+	/* The rest is just a straight decode loop until end of stream */
+	while( isEnd == false && readPage( &page ) )
+	{
+		ogg_stream_pagein( &m_stream, &page ); /* can safely ignore errors at
+	                                           this point */
 
-						if( result == 0 ) { break; }
+		decodePackets( &m_stream, &synthesis.dsp, &synthesis.block, headers.info.channels );
 
-						if( result < 0 )
-						{
-							/* Uh oh; data at some point was corrupted or missing!
-							   We can't tolerate that in a header.  Die. */
-							KLOG( "Corrupt secondary header.  Exiting.\n" );
-							assert( false );
-							return Data();
-						}
+		isEnd = ogg_page_eos( &page ) != 0;
+	}
 
-						result = vorbis_synthesis_headerin( &vi, &vc, &op );
+	return true;
+}
 
-						if( result < 0 )
-						{
-							KLOG( "Corrupt secondary header.  Exiting.\n" );
-							assert( false );
-							return Data();
-						}
+/**
+ * Check that there is a whole page with correct CRC at pData.
+ * @param pPage on success points to page inside pData
+ */
+static bool getPage( const unsigned char* pData, size_t available, ogg_page* pPage )
+{
+	const int headerSize = 27;
 
-						i++;
-					}
-				}
-			}
+	if( available < headerSize || memcmp( pData, "OggS", 4 ) != 0 || pData[4] != 0 )
+	{
+		return false;
+	}
 
-			/* no harm in not checking before adding more */
-			buffer = ogg_sync_buffer( &oy, block4k );
+	const int segments = pData[26];
 
-			encodedStream.read( buffer, block4k );
-			bytes = encodedStream.gcount();
+	if( available < static_cast<size_t>( headerSize + segments ) )
+	{
+		return false;
+	}
 
-			if( bytes == 0 && i < 2 )
-			{
-				KLOG( "End of file before finding all Vorbis headers!\n" );
-				assert( false );
-				return Data();
-			}
+	size_t bodySize = 0;
 
-			ogg_sync_wrote( &oy, bytes );
-		}
+	for( int i = 0; i < segments; ++i )
+	{
+		bodySize += pData[headerSize + i];
+	}
+
+	if( available < headerSize + segments + bodySize )
+	{
+		return false;
+	}
+
+	//ogg_page_checksum_set writes to header so it gets a copy
+	unsigned char header[headerSize + 255];
+	memcpy( header, pData, headerSize + segments );
+
+	pPage->header = header;
+	pPage->header_len = headerSize + segments;
+	pPage->body = const_cast<unsigned char*>( pData ) + headerSize + segments;
+	pPage->body_len = bodySize;
+	ogg_page_checksum_set( pPage );
+
+	pPage->header = const_cast<unsigned char*>( pData );
+	return memcmp( header + 22, pData + 22, 4 ) == 0;
+}
+
+bool OggDecoder::readFormat( const char* pData, size_t size, int& channelsCount, int& bitrate )
+{
+	ogg_page page;
+
+	if( pData == nullptr || getPage( reinterpret_cast<const unsigned char*>( pData ), size, &page ) == false )
+	{
+		return false;
+	}
+
+	//Packet type, "vorbis", version, channels, rate. Whole header is 30 bytes and it is alone in first page.
+	const unsigned char* pHeader = page.body;
+
+	if( page.body_len < 30 || pHeader[0] != 1 || memcmp( pHeader + 1, "vorbis", 6 ) != 0 || pHeader[11] == 0 )
+	{
+		return false;
+	}
+
+	channelsCount = pHeader[11];
+	//Sample rate, nominal bitrate would be bytes 20..23
+	//Bytes are promoted to int, shifting 0x80 and above to sign bit would be undefined
+	const unsigned int rate = static_cast<unsigned int>( pHeader[12] ) |
+							  static_cast<unsigned int>( pHeader[13] ) << 8 |
+							  static_cast<unsigned int>( pHeader[14] ) << 16 |
+							  static_cast<unsigned int>( pHeader[15] ) << 24;
+	bitrate = static_cast<int>( rate );
+	return true;
+}
+
+long long OggDecoder::findTotalFrames( int maxPacketFrames ) const
+{
+	const unsigned char* pData = reinterpret_cast<const unsigned char*>( m_pInput );
+	ogg_page page;
+
+	if( getPage( pData, m_inputSize, &page ) == false )
+	{
+		return -1;
+	}
+
+	const int serial = ogg_page_serialno( &page );
+	long long firstGranule = 0;
 
-		/* Throw the comments plus a few lines about the bitstream we're
-		   decoding */
+	/* Stream may start at granule > 0, e.g. clip cut from longer stream. First page after headers tells where,
+	   less frames of packets which end on it. */
+	for( size_t offset = 0; getPage( pData + offset, m_inputSize - offset, &page ) &&
+			ogg_page_serialno( &page ) == serial; offset += page.header_len + page.body_len )
+	{
+		const long long granule = ogg_page_granulepos( &page );
+
+		if( granule > 0 )
 		{
-			char** ptr = vc.user_comments;
+			firstGranule = std::max( 0LL, granule - static_cast<long long>( ogg_page_packets( &page ) ) *
+									 maxPacketFrames );
+			break;
+		}
+	}
 
-			while( *ptr )
-			{
-				KLOG( "%s\n", *ptr );
-				++ptr;
-			}
+	/* Last page is usually within few kB from the end. Pages cut by end of buffer or with bad CRC are
+	   skipped, as well as pages where no packet ends (granule -1). */
+	for( size_t offset = m_inputSize; offset-- > 0; )
+	{
+		if( pData[offset] != 'O' || getPage( pData + offset, m_inputSize - offset, &page ) == false )
+		{
+			continue;
+		}
 
-			outputData.bitrate = vi.rate;
-			outputData.channelsCount = vi.channels;
+		const long long granule = ogg_page_granulepos( &page );
 
-			KLOG( "\nBitstream is %d channel, %ldHz\n", vi.channels, vi.rate );
-			KLOG( "Encoded by: %s\n\n", vc.vendor );
+		if( granule < 0 )
+		{
+			continue;
 		}
 
-		convsize = block4k / vi.channels;
+		return ogg_page_serialno( &page ) == serial && granule > firstGranule ? granule - firstGranule : -1;
+	}
+
+	return -1;
+}
+
+char* OggDecoder::reserveOutput( size_t size )
+{
+	if( m_outputSize + size > m_outputCapacity )
+	{
+		//Only when we don't know length up front or it was wrong. Grow geometrically.
+		const size_t minCapacity = 64 * 1024;
+		const size_t capacity = std::max( { m_outputSize + size, m_outputCapacity * 2, minCapacity } );
+
+		char* pOutput = new char[capacity];
 
-		/* OK, got and parsed all three headers. Initialize the Vorbis
-		   packet->PCM decoder. */
-		if( vorbis_synthesis_init( &vd, &vi ) == 0 )   /* central decode state */
+		if( m_outputSize > 0 )
 		{
-			vorbis_block_init( &vd, &vb );          /* local state for most of the decode
-	                                              so multiple block decodes can
-	                                              proceed in parallel. We could init
-	                                              multiple vorbis_block structures
-	                                              for vd here */
-
-			/* The rest is just a straight decode loop until end of stream */
-			while( !eos )
-			{
-				while( !eos )
-				{
-					int result = ogg_sync_pageout( &oy, &og );
+			memcpy( pOutput, m_pOutput, m_outputSize );
+		}
 
-					if( result == 0 ) { break; }  /* need more data */
+		delete[] m_pOutput;
+		m_pOutput = pOutput;
+		m_outputCapacity = capacity;
+	}
 
-					if( result < 0 )  /* missing or corrupt data at this page position */
-					{
-						KLOG( "Corrupt or missing data in bitstream;\ncontinuing...\n" );
-					}
-					else
-					{
-						ogg_stream_pagein( &os, &og ); /* can safely ignore errors at
-	                                           this point */
+	char* pWrite = m_pOutput + m_outputSize;
+	m_outputSize += size;
+	return pWrite;
+}
 
-						while( 1 )
-						{
-							result = ogg_stream_packetout( &os, &op );
-
-							if( result == 0 ) { break; }  /* need more data */
-
-							if( result < 0 )  /* missing or corrupt data at this page position */
-							{
-								/* no reason to complain; already complained above */
-							}
-							else
-							{
-								/* we have a packet.  Decode it */
-								float** pcm;
-								int samples;
-
-								if( vorbis_synthesis( &vb, &op ) == 0 )   /* test for success! */
-								{
-									vorbis_synthesis_blockin( &vd, &vb );
-								}
-
-								/*
-
-								**pcm is a multichannel float vector.  In stereo, for
-								example, pcm[0] is left, and pcm[1] is right.  samples is
-								the size of each channel.  Convert the float values
-								(-1.<=range<=1.) to whatever PCM format and write it out */
-
-								while( ( samples = vorbis_synthesis_pcmout( &vd, &pcm ) ) > 0 )
-								{
-									int j;
-									int clipflag = 0;
-									int bout = ( samples < convsize ? samples : convsize );
-
-									/* convert floats to 16 bit signed ints (host order) and
-									   interleave */
-									for( i = 0; i < vi.channels; i++ )
-									{
-										ogg_int16_t* ptr = m_convertBuffer + i;
-										float*  mono = pcm[i];
-
-										for( j = 0; j < bout; j++ )
-										{
-#if 1
-											int val = floor( mono[j] * 32767.f + .5f );
-#else /* optional dither */
-											int val = mono[j] * 32767.f + drand48() - 0.5f;
-#endif
+void OggDecoder::setSharedSetupHeader( const char* pData, size_t size )
+{
+	m_sharedSetup.assign( pData, pData + size );
+}
 
-											/* might as well guard against clipping */
-											if( val > 32767 )
-											{
-												val = 32767;
-												clipflag = 1;
-											}
+bool OggDecoder::isAudioPacketNext( ogg_stream_state* pStream )
+{
+	ogg_packet packet;
 
-											if( val < -32768 )
-											{
-												val = -32768;
-												clipflag = 1;
-											}
+	if( ogg_stream_packetpeek( pStream, &packet ) != 1 )
+	{
+		return false;
+	}
 
-											*ptr = val;
-											ptr += vi.channels;
-										}
-									}
+	return packet.bytes > 0 && ( packet.packet[0] & 1 ) == 0;
+}
 
-									if( clipflag )
-									{
-										KLOG( "Clipping in frame %ld\n", ( long )( vd.sequence ) );
-									}
+std::shared_ptr<vorbis_info> OggDecoder::acquireSharedSetup( const std::vector<unsigned char>& identification,
+		vorbis_comment* pComment )
+{
+	if( m_sharedSetup.empty() )
+	{
+		KLOG( "Stream has no setup header and shared setup header isn't set" );
+		return nullptr;
+	}
 
+	//Without tag we can't tell stream is from our bank, codebooks of other bank would decode it to noise
+	const char* pExpected = vorbis_comment_query( pComment, SHARED_SETUP_TAG, 0 );
 
+	if( pExpected == nullptr )
+	{
+		KLOG( "Stream has no setup header and no %s tag", SHARED_SETUP_TAG );
+		return nullptr;
+	}
 
-									decodedStream.write( reinterpret_cast<char*>( m_convertBuffer ), 2 * vi.channels * bout );
+	const unsigned long long expected = strtoull( pExpected, nullptr, 16 );
 
-									vorbis_synthesis_read( &vd, bout ); /* tell libvorbis how
-	                                                      many samples we
-	                                                      actually consumed */
-								}
-							}
-						}
+	if( expected != VorbisSetupCache::hash( m_sharedSetup.data(), m_sharedSetup.size() ) )
+	{
+		KLOG( "Shared setup header doesn't match the one stream was encoded with" );
+		return nullptr;
+	}
 
-						if( ogg_page_eos( &og ) ) { eos = 1; }
-					}
-				}
+	ogg_packet packet;
+	memset( &packet, 0, sizeof( packet ) );
+	packet.packet = m_sharedSetup.data();
+	packet.bytes = m_sharedSetup.size();
+	packet.packetno = 2;
+
+	return VorbisSetupCache::getInstance().acquire( identification, &packet, pComment );
+}
+
+void OggDecoder::decodePackets( ogg_stream_state* pStream, vorbis_dsp_state* pDsp, vorbis_block* pBlock, int channels )
+{
+	ogg_packet op;
+
+	while( 1 )
+	{
+		int result = ogg_stream_packetout( pStream, &op );
+
+		if( result == 0 ) { break; }  /* need more data */
+
+		if( result < 0 )  /* missing or corrupt data at this page position */
+		{
+			/* no reason to complain; already complained above */
+			continue;
+		}
+
+		/* we have a packet.  Decode it */
+		float** pcm;
+		int samples;
+
+		if( vorbis_synthesis( pBlock, &op ) == 0 )   /* test for success! */
+		{
+			vorbis_synthesis_blockin( pDsp, pBlock );
+		}
 
-				if( !eos )
+		/*
+
+		**pcm is a multichannel float vector.  In stereo, for
+		example, pcm[0] is left, and pcm[1] is right.  samples is
+		the size of each channel.  Convert the float values
+		(-1.<=range<=1.) to whatever PCM format and write it out */
+
+		while( ( samples = vorbis_synthesis_pcmout( pDsp, &pcm ) ) > 0 )
+		{
+			int clipflag = 0;
+			int bout = samples;
+			ogg_int16_t* pOutput = reinterpret_cast<ogg_int16_t*>( reserveOutput( 2 * channels * bout ) );
+
+			/* convert floats to 16 bit signed ints (host order) and
+			   interleave */
+			for( int i = 0; i < channels; i++ )
+			{
+				ogg_int16_t* ptr = pOutput + i;
+				float*  mono = pcm[i];
+
+				for( int j = 0; j < bout; j++ )
 				{
-					buffer = ogg_sync_buffer( &oy, block4k );
-					encodedStream.read( buffer, block4k );
-					bytes = encodedStream.gcount();
+#if 1
+					int val = floor( mono[j] * 32767.f + .5f );
+#else /* optional dither */
+					int val = mono[j] * 32767.f + drand48() - 0.5f;
+#endif
 
-					ogg_sync_wrote( &oy, bytes );
+					/* might as well guard against clipping */
+					if( val > 32767 )
+					{
+						val = 32767;
+						clipflag = 1;
+					}
 
-					if( bytes == 0 ) { eos = 1; }
+					if( val < -32768 )
+					{
+						val = -32768;
+						clipflag = 1;
+					}
+
+					*ptr = val;
+					ptr += channels;
 				}
 			}
 
-			/* ogg_page and ogg_packet structs always point to storage in
-			   libvorbis.  They're never freed or manipulated directly */
+			if( clipflag )
+			{
+				KLOG( "Clipping in frame %ld\n", ( long )( pDsp->sequence ) );
+			}
 
-			vorbis_block_clear( &vb );
-			vorbis_dsp_clear( &vd );
+			vorbis_synthesis_read( pDsp, bout ); /* tell libvorbis how
+	                                              many samples we
+	                                              actually consumed */
 		}
-		else
+	}
+}
+
+/**
+ * @return value of comment with given tag (case insensitive) or nullptr if comment has other tag
+ */
+static const char* getCommentValue( const char* pComment, const char* pTag )
+{
+	while( *pTag != '\0' )
+	{
+		if( toupper( static_cast<unsigned char>( *pComment ) ) != *pTag )
 		{
-			KLOG( "Error: Corrupt header during playback initialization.\n" );
+			return nullptr;
 		}
 
-		/* clean up this logical bitstream; before exit we see if we're
-		   followed by another [chained] */
-
-		ogg_stream_clear( &os );
-		vorbis_comment_clear( &vc );
-		vorbis_info_clear( &vi );  /* must be called last */
+		++pComment;
+		++pTag;
 	}
 
-	/* OK, clean up the framer */
-	ogg_sync_clear( &oy );
-
+	return *pComment == '=' ? pComment + 1 : nullptr;
+}
 
-	decodedStream.seekg( 0, decodedStream.end );
-	outputData.size = decodedStream.tellg();
-	decodedStream.seekg( 0, decodedStream.beg );
+bool OggDecoder::readLoopPoints( const vorbis_comment* pComment, int& loopStart, int& loopLength )
+{
+	loopStart = 0;
+	loopLength = 0;
 
-	if( outputData.size < 1 )
+	if( pComment == nullptr || pComment->user_comments == nullptr )
 	{
-		KLOG( "Problems with decoded stream!" );
-		assert( false );
-		return Data();
+		return false;
 	}
 
-	outputData.pData = new char[outputData.size];
+	long start = -1;
+	long length = -1;
 
-	decodedStream.read( outputData.pData, outputData.size );
+	for( int i = 0; i < pComment->comments; ++i )
+	{
+		const char* pValue = nullptr;
 
-	KLOG( "Done.\n" );
+		if( ( pValue = getCommentValue( pComment->user_comments[i], "LOOPSTART" ) ) != nullptr )
+		{
+			start = strtol( pValue, nullptr, 10 );
+		}
+		else if( ( pValue = getCommentValue( pComment->user_comments[i], "LOOPLENGTH" ) ) != nullptr )
+		{
+			length = strtol( pValue, nullptr, 10 );
+		}
+	}
 
-	return outputData;
+	if( start < 0 || length < 1 )
+	{
+		return false;
+	}
+
+	loopStart = start;
+	loopLength = length;
+	KLOG( "Loop points start: %d length: %d", loopStart, loopLength );
+	return true;
 }
 
 } /* namespace KoalaSound */
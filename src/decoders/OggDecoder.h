@@ -8,6 +8,7 @@
 #ifndef OGGLOADER_H_
 #define OGGLOADER_H_
 
+#include <memory>
 #include <vector>
 
 #include "ogg/ogg.h"
@@ -17,7 +18,6 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
-#include <sstream>
 
 #include <vorbis/codec.h>
 
@@ -33,6 +33,8 @@ struct Data
 		, size( 0 )
 		, channelsCount( 0 )
 		, bitrate( 0 )
+		, loopStart( 0 )
+		, loopLength( 0 )
 	{
 	}
 	/**
@@ -53,26 +55,140 @@ struct Data
 	 * Bitrate
 	 */
 	int bitrate;
+
+	/**
+	 * First frame of loop body. Read from LOOPSTART comment.
+	 */
+	int loopStart;
+
+	/**
+	 * Count of frames in loop body. Read from LOOPLENGTH comment. 0 if stream has no loop points.
+	 */
+	int loopLength;
 };
 
+/**
+ * Decodes whole .ogg files to PCM. Keep one instance and reuse it, it keeps ogg buffers between decodes.
+ * Not thread safe, use one instance per thread.
+ */
 class OggDecoder
 {
 public:
 	OggDecoder();
 	~OggDecoder();
 
+	//We want block them
+	OggDecoder( OggDecoder const& ) = delete;
+	void operator= ( OggDecoder const& ) = delete;
+
 	/**
-	 * Decode .ogg file.
+	 * Decode .ogg file. Chained links must have the same channels count and rate as the first one,
+	 * links with other format are skipped.
+	 * Output buffer is allocated once, sized from granule position of the last page. Only chained and
+	 * damaged files need to grow it.
 	 * @param pData encoded ogg file data. Simply read all file to buffer and pass it here.
 	 * @param size size of the buffer ( ogg file size)
 	 * @return decoded ogg as PCM in simple structure. If any error occurs empty Data structure is returned (Data::pData i nullptr , Data::size == 0...)
 	 */
 	Data decode( const char* pData, size_t size );
 
+	/**
+	 * Read loop points from LOOPSTART and LOOPLENGTH comments (values in sample frames).
+	 * @param pComment comments of stream
+	 * @param loopStart first frame of loop body, 0 if there are no loop points
+	 * @param loopLength count of frames in loop body, 0 if there are no loop points
+	 * @return true if stream has valid loop points
+	 */
+	static bool readLoopPoints( const vorbis_comment* pComment, int& loopStart, int& loopLength );
+
+	/**
+	 * Read format from identification header in first page, without decoding anything.
+	 * @param pData encoded ogg file data
+	 * @param size size of the buffer
+	 * @param channelsCount channels count of the (first link of) stream
+	 * @param bitrate sampling rate in Hz, like Data::bitrate
+	 * @return false if first page isn't valid Vorbis identification header
+	 */
+	static bool readFormat( const char* pData, size_t size, int& channelsCount, int& bitrate );
+
+	/**
+	 * Set setup header (third Vorbis header, the codebooks) for streams encoded without it.
+	 * koala_encode -s writes such streams and one shared setup header file for the whole bank. Tiny sound
+	 * effects are then a few hundred bytes instead of few kilobytes and codebooks are parsed only once.
+	 * Streams which carry own setup header still use it. Stream without it is decoded only if its
+	 * SHARED_SETUP_TAG matches this header.
+	 * @param pData setup header packet, as written by koala_encode -s
+	 * @param size size of the packet
+	 */
+	void setSharedSetupHeader( const char* pData, size_t size );
+
+	/**
+	 * Comment tag written by koala_encode to streams without setup header. Value is hash of the shared
+	 * setup header in hex, so we can refuse a header from another bank.
+	 */
+	static const char* const SHARED_SETUP_TAG;
+
 private:
-	const int m_convertBufferSize;
-	/* take 8k (4096) out of the data segment, not the stack */
-	ogg_int16_t* m_convertBuffer;
+	std::vector<unsigned char> m_sharedSetup;
+
+	ogg_sync_state m_sync; /* sync and verify incoming physical bitstream */
+	ogg_stream_state m_stream; /* take physical pages, weld into a logical stream of packets */
+
+	/**
+	 * Encoded data of current decode() call. Not copied.
+	 */
+	const char* m_pInput;
+	size_t m_inputSize;
+	size_t m_inputPosition;
+
+	/**
+	 * PCM of current decode() call. Ownership goes to returned Data.
+	 */
+	char* m_pOutput;
+	size_t m_outputSize;
+	size_t m_outputCapacity;
+
+	/**
+	 * Get next page, feeding sync layer from input as needed.
+	 * @return false at end of input
+	 */
+	bool readPage( ogg_page* pPage );
+
+	/**
+	 * Parse headers and decode one link of (possibly chained) stream.
+	 * @param pFirstPage beginning of stream page of this link
+	 * @param output format of first link is stored here, next links must match it
+	 * @return false on fatal error
+	 */
+	bool decodeLink( ogg_page* pFirstPage, Data& output );
+
+	/**
+	 * Find last page of input which finishes a packet, scanning backward like _get_prev_page in vorbisfile.c.
+	 * @param maxPacketFrames most frames one audio packet decodes to, half of long block
+	 * @return its granule position less granule where stream starts, which is PCM length of the stream (at
+	 * 			most one page more). -1 if unknown (no such page or chained stream, where last page tells only
+	 * 			about last link).
+	 */
+	long long findTotalFrames( int maxPacketFrames ) const;
+
+	/**
+	 * Make room for size more bytes at the end of output.
+	 * @return where to write them
+	 */
+	char* reserveOutput( size_t size );
+
+	/**
+	 * @return true if next packet in stream is audio packet (Vorbis header packets have odd type)
+	 */
+	static bool isAudioPacketNext( ogg_stream_state* pStream );
+
+	std::shared_ptr<vorbis_info> acquireSharedSetup( const std::vector<unsigned char>& identification,
+			vorbis_comment* pComment );
+
+	/**
+	 * Decode all complete packets waiting in stream state and append PCM to output.
+	 */
+	void decodePackets( ogg_stream_state* pStream, vorbis_dsp_state* pDsp, vorbis_block* pBlock, int channels );
 };
 
 } /* namespace KoalaSound */
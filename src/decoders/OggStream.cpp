@@ -0,0 +1,358 @@
+/*
+ * OggStream.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "decoders/OggStream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "Log.h"
+
+namespace KoalaSound
+{
+
+OggStream::OggStream() :
+	m_pData( nullptr )
+	, m_size( 0 )
+	, m_position( 0 )
+	, m_length( 0 )
+	, m_channelsCount( 0 )
+	, m_rate( 0 )
+{
+	memset( &m_file, 0, sizeof( m_file ) );
+}
+
+OggStream::~OggStream()
+{
+	close();
+}
+
+bool OggStream::open( const char* pData, size_t size )
+{
+	close();
+
+	if( pData == nullptr || size < 1 )
+	{
+		KLOG( "Empty ogg buffer" );
+		return false;
+	}
+
+	m_pData = pData;
+	m_size = size;
+	m_position = 0;
+
+	ov_callbacks callbacks;
+	callbacks.read_func = &OggStream::readCallback;
+	callbacks.seek_func = &OggStream::seekCallback;
+	callbacks.close_func = nullptr;
+	callbacks.tell_func = &OggStream::tellCallback;
+
+	const int result = ov_open_callbacks( this, &m_file, nullptr, 0, callbacks );
+
+	if( result != 0 )
+	{
+		KLOG( "Can't open ogg stream. Error: %d", result );
+		m_pData = nullptr;
+		m_size = 0;
+		return false;
+	}
+
+	vorbis_info* pInfo = ov_info( &m_file, -1 );
+	m_channelsCount = pInfo->channels;
+	m_rate = pInfo->rate;
+	m_length = ov_pcm_total( &m_file, -1 );
+
+	if( m_length < 0 )
+	{
+		m_length = 0;
+	}
+
+	m_discardBuffer.resize( 4096 * m_channelsCount );
+
+	buildPageIndex();
+
+	KLOG( "Opened ogg stream %d channel, %dHz, %lld frames, %d pages", m_channelsCount, m_rate, m_length,
+		  static_cast<int>( m_pageIndex.size() ) );
+	return true;
+}
+
+void OggStream::close()
+{
+	if( m_pData == nullptr )
+	{
+		return;
+	}
+
+	ov_clear( &m_file );
+	memset( &m_file, 0, sizeof( m_file ) );
+
+	m_pData = nullptr;
+	m_size = 0;
+	m_position = 0;
+	m_length = 0;
+	m_channelsCount = 0;
+	m_rate = 0;
+	m_pageIndex.clear();
+}
+
+int OggStream::read( char* pBuffer, int frames )
+{
+	if( isOpen() == false )
+	{
+		return -1;
+	}
+
+	const int frameSize = 2 * m_channelsCount;
+	int bytes = frames * frameSize;
+	int decoded = 0;
+
+	while( bytes > 0 )
+	{
+		int bitstream = 0;
+		const long result = ov_read( &m_file, pBuffer + decoded, bytes, 0, 2, 1, &bitstream );
+
+		if( result == 0 )
+		{
+			break;
+		}
+
+		if( result == OV_HOLE )
+		{
+			/* corrupt or missing data, just continue */
+			continue;
+		}
+
+		if( result < 0 )
+		{
+			KLOG( "Error while decoding ogg stream: %d", static_cast<int>( result ) );
+			return decoded > 0 ? decoded / frameSize : -1;
+		}
+
+		decoded += result;
+		bytes -= result;
+	}
+
+	return decoded / frameSize;
+}
+
+bool OggStream::seek( long long frame )
+{
+	if( isOpen() == false )
+	{
+		return false;
+	}
+
+	frame = std::max( 0LL, std::min( frame, m_length ) );
+
+	if( ov_streams( &m_file ) == 1 && m_pageIndex.empty() == false )
+	{
+		/* First page which ends at or after wanted frame. We start 2 pages earlier so decoder lapping is
+		   primed before we reach wanted frame, then we decode and drop only few packets */
+		const long long granule = frame + m_file.pcmlengths[0];
+		auto found = std::lower_bound( m_pageIndex.begin(), m_pageIndex.end(), granule,
+									   []( const PageEntry & entry, long long value )
+		{
+			return entry.granule < value;
+		} );
+
+		size_t index = found - m_pageIndex.begin();
+		index = index > 2 ? index - 2 : 0;
+
+		if( ov_raw_seek( &m_file, m_pageIndex[index].offset ) == 0 )
+		{
+			const long long position = ov_pcm_tell( &m_file );
+
+			if( position >= 0 && position <= frame )
+			{
+				return discardFrames( frame - position );
+			}
+		}
+
+		KLOG( "Page index seek failed, falling back to bisection" );
+	}
+
+	//Chained streams or index miss. Let vorbisfile bisect.
+	const int result = ov_pcm_seek( &m_file, frame );
+
+	if( result != 0 )
+	{
+		KLOG( "Can't seek to frame %lld. Error: %d", frame, result );
+		return false;
+	}
+
+	return true;
+}
+
+long long OggStream::tell()
+{
+	if( isOpen() == false )
+	{
+		return 0;
+	}
+
+	return ov_pcm_tell( &m_file );
+}
+
+vorbis_comment* OggStream::getComment()
+{
+	if( isOpen() == false )
+	{
+		return nullptr;
+	}
+
+	return ov_comment( &m_file, 0 );
+}
+
+void OggStream::buildPageIndex()
+{
+	/* Only page headers are read here, it is cheap compared to decoding. See framing.html for layout.
+	   CRC isn't checked, vorbisfile will do it when we seek there. */
+	const int headerSize = 27;
+	const unsigned char* pData = reinterpret_cast<const unsigned char*>( m_pData );
+
+	m_pageIndex.clear();
+
+	bool hasSerial = false;
+	unsigned int serial = 0;
+	size_t offset = 0;
+
+	while( offset + headerSize <= m_size )
+	{
+		const unsigned char* pPage = pData + offset;
+
+		if( memcmp( pPage, "OggS", 4 ) != 0 )
+		{
+			KLOG( "Lost page sync at offset %d, page index stops here", static_cast<int>( offset ) );
+			break;
+		}
+
+		const int segments = pPage[26];
+
+		if( offset + headerSize + segments > m_size )
+		{
+			break;
+		}
+
+		size_t pageSize = headerSize + segments;
+
+		for( int i = 0; i < segments; ++i )
+		{
+			pageSize += pPage[headerSize + i];
+		}
+
+		long long granule = 0;
+
+		for( int i = 7; i >= 0; --i )
+		{
+			granule = ( granule << 8 ) | pPage[6 + i];
+		}
+
+		const unsigned int pageSerial = pPage[14] | ( pPage[15] << 8 ) | ( pPage[16] << 16 ) |
+										( static_cast<unsigned int>( pPage[17] ) << 24 );
+
+		if( hasSerial == false )
+		{
+			hasSerial = true;
+			serial = pageSerial;
+		}
+
+		if( pageSerial != serial )
+		{
+			//Next link of chained stream. We index only first one.
+			break;
+		}
+
+		//Header pages have granule 0 and pages without finished packet -1
+		if( granule > 0 )
+		{
+			PageEntry entry = { static_cast<long long>( offset ), granule };
+			m_pageIndex.push_back( entry );
+		}
+
+		offset += pageSize;
+	}
+}
+
+bool OggStream::discardFrames( long long frames )
+{
+	const int frameSize = 2 * m_channelsCount;
+	const int bufferFrames = m_discardBuffer.size() / frameSize;
+
+	while( frames > 0 )
+	{
+		const int decoded = read( m_discardBuffer.data(),
+								  static_cast<int>( std::min<long long>( frames, bufferFrames ) ) );
+
+		if( decoded <= 0 )
+		{
+			return false;
+		}
+
+		frames -= decoded;
+	}
+
+	return true;
+}
+
+size_t OggStream::readCallback( void* pPtr, size_t size, size_t count, void* pDataSource )
+{
+	OggStream* pStream = static_cast<OggStream*>( pDataSource );
+	assert( pStream );
+
+	const size_t available = pStream->m_size - pStream->m_position;
+	const size_t bytes = std::min( size * count, available );
+
+	memcpy( pPtr, pStream->m_pData + pStream->m_position, bytes );
+	pStream->m_position += bytes;
+
+	return size > 0 ? bytes / size : 0;
+}
+
+int OggStream::seekCallback( void* pDataSource, ogg_int64_t offset, int whence )
+{
+	OggStream* pStream = static_cast<OggStream*>( pDataSource );
+	assert( pStream );
+
+	long long position;
+
+	switch( whence )
+	{
+		case SEEK_SET:
+			position = offset;
+			break;
+
+		case SEEK_CUR:
+			position = pStream->m_position + offset;
+			break;
+
+		case SEEK_END:
+			position = pStream->m_size + offset;
+			break;
+
+		default:
+			return -1;
+	}
+
+	if( position < 0 || position > static_cast<long long>( pStream->m_size ) )
+	{
+		return -1;
+	}
+
+	pStream->m_position = position;
+	return 0;
+}
+
+long OggStream::tellCallback( void* pDataSource )
+{
+	OggStream* pStream = static_cast<OggStream*>( pDataSource );
+	assert( pStream );
+	return pStream->m_position;
+}
+
+} /* namespace KoalaSound */
@@ -0,0 +1,124 @@
+/*
+ * OggStream.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef OGGSTREAM_H_
+#define OGGSTREAM_H_
+
+#include <vector>
+
+#include <vorbis/vorbisfile.h>
+
+namespace KoalaSound
+{
+
+/**
+ * Streaming decoder of .ogg file kept in memory. Unlike OggDecoder it decodes only as much as you ask
+ * for and it can jump to any sample frame.
+ * Streams without setup header (koala_encode -s) aren't supported, decode them with OggDecoder.
+ */
+class OggStream
+{
+public:
+	OggStream();
+	~OggStream();
+
+	//We want block them
+	OggStream( OggStream const& ) = delete;
+	void operator= ( OggStream const& ) = delete;
+
+	/**
+	 * Open stream. Buffer isn't copied so it must be valid until close() or destruction of this object.
+	 * @param pData encoded ogg file data
+	 * @param size size of the buffer ( ogg file size)
+	 * @return true if everything is ok, false otherwise
+	 */
+	bool open( const char* pData, size_t size );
+
+	void close();
+
+	inline bool isOpen() const
+	{
+		return m_pData != nullptr;
+	}
+
+	/**
+	 * Decode next frames as interleaved signed 16 bit PCM.
+	 * @param pBuffer output buffer, must have space for frames * getChannelsCount() samples
+	 * @param frames maximum count of frames to decode
+	 * @return count of decoded frames. 0 at end of stream, negative value if any error occurs.
+	 */
+	int read( char* pBuffer, int frames );
+
+	/**
+	 * Move decoding position to given frame. Position is sample accurate.
+	 * @param frame frame index counted from beginning of the stream
+	 * @return true if everything is ok, false otherwise
+	 */
+	bool seek( long long frame );
+
+	/**
+	 * @return position of next frame returned by read()
+	 */
+	long long tell();
+
+	/**
+	 * @return total count of frames in stream
+	 */
+	inline long long getLength() const
+	{
+		return m_length;
+	}
+
+	inline int getChannelsCount() const
+	{
+		return m_channelsCount;
+	}
+
+	inline int getRate() const
+	{
+		return m_rate;
+	}
+
+	/**
+	 * @return comments of first link or nullptr if stream isn't opened
+	 */
+	vorbis_comment* getComment();
+
+private:
+	struct PageEntry
+	{
+		long long offset;
+		long long granule;
+	};
+
+	OggVorbis_File m_file;
+
+	const char* m_pData;
+	size_t m_size;
+	size_t m_position;
+
+	long long m_length;
+	int m_channelsCount;
+	int m_rate;
+
+	/**
+	 * Offsets and granule positions of all pages in first logical stream. Built once in open().
+	 */
+	std::vector<PageEntry> m_pageIndex;
+	std::vector<char> m_discardBuffer;
+
+	void buildPageIndex();
+	bool discardFrames( long long frames );
+
+	static size_t readCallback( void* pPtr, size_t size, size_t count, void* pDataSource );
+	static int seekCallback( void* pDataSource, ogg_int64_t offset, int whence );
+	static long tellCallback( void* pDataSource );
+};
+
+} /* namespace KoalaSound */
+
+#endif /* OGGSTREAM_H_ */
@@ -0,0 +1,188 @@
+/*
+ * VorbisSetupCache.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "decoders/VorbisSetupCache.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "Log.h"
+
+namespace KoalaSound
+{
+
+struct VorbisSetupCache::Entry
+{
+	Entry()
+	{
+		vorbis_info_init( &info );
+	}
+
+	~Entry()
+	{
+		vorbis_info_clear( &info );
+	}
+
+	/**
+	 * Identification header bytes followed by setup header bytes
+	 */
+	std::vector<unsigned char> key;
+	vorbis_info info;
+};
+
+unsigned long long VorbisSetupCache::hash( const unsigned char* pData, size_t size )
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for( size_t i = 0; i < size; ++i )
+	{
+		hash ^= pData[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+VorbisSetupCache& VorbisSetupCache::getInstance()
+{
+	static VorbisSetupCache instance;
+	return instance;
+}
+
+VorbisSetupCache::VorbisSetupCache()
+{
+}
+
+VorbisSetupCache::~VorbisSetupCache()
+{
+}
+
+std::shared_ptr<vorbis_info> VorbisSetupCache::acquire( const std::vector<unsigned char>& identification,
+		const ogg_packet* pSetup, vorbis_comment* pComment )
+{
+	assert( pSetup != nullptr );
+
+	std::vector<unsigned char> key;
+	key.reserve( identification.size() + pSetup->bytes );
+	key.insert( key.end(), identification.begin(), identification.end() );
+	key.insert( key.end(), pSetup->packet, pSetup->packet + pSetup->bytes );
+
+	const unsigned long long keyHash = hash( key.data(), key.size() );
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		auto found = m_entries.find( keyHash );
+
+		if( found != m_entries.end() && found->second->key == key )
+		{
+			std::shared_ptr<Entry> pEntry = found->second;
+			return std::shared_ptr<vorbis_info>( pEntry, &pEntry->info );
+		}
+	}
+
+	//Parse outside of lock, other decoders can still use cache meanwhile
+	std::shared_ptr<Entry> pEntry = createEntry( std::move( key ), identification.size(), pComment );
+
+	if( pEntry == nullptr )
+	{
+		return nullptr;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		auto inserted = m_entries.emplace( keyHash, pEntry );
+
+		if( inserted.second == false )
+		{
+			if( inserted.first->second->key == pEntry->key )
+			{
+				//Somebody was faster, use his entry and drop ours
+				pEntry = inserted.first->second;
+			}
+			else
+			{
+				//Hash collision, we just don't cache this one
+				KLOG( "Setup header hash collision" );
+			}
+		}
+		else
+		{
+			KLOG( "Cached new setup header. Cache size: %d", static_cast<int>( m_entries.size() ) );
+		}
+	}
+
+	return std::shared_ptr<vorbis_info>( pEntry, &pEntry->info );
+}
+
+void VorbisSetupCache::purgeUnused()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+
+	for( auto it = m_entries.begin(); it != m_entries.end(); )
+	{
+		if( it->second.use_count() == 1 )
+		{
+			it = m_entries.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+size_t VorbisSetupCache::size() const
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	return m_entries.size();
+}
+
+std::shared_ptr<VorbisSetupCache::Entry> VorbisSetupCache::createEntry( std::vector<unsigned char>&& key,
+		size_t identificationSize, vorbis_comment* pComment )
+{
+	std::shared_ptr<Entry> pEntry = std::make_shared<Entry>();
+	pEntry->key = std::move( key );
+
+	ogg_packet packet;
+	memset( &packet, 0, sizeof( packet ) );
+	packet.packet = pEntry->key.data();
+	packet.bytes = identificationSize;
+	packet.b_o_s = 1;
+
+	if( vorbis_synthesis_headerin( &pEntry->info, pComment, &packet ) < 0 )
+	{
+		KLOG( "Corrupt identification header" );
+		return nullptr;
+	}
+
+	packet.packet = pEntry->key.data() + identificationSize;
+	packet.bytes = pEntry->key.size() - identificationSize;
+	packet.b_o_s = 0;
+	packet.packetno = 2;
+
+	if( vorbis_synthesis_headerin( &pEntry->info, pComment, &packet ) < 0 )
+	{
+		KLOG( "Corrupt setup header" );
+		return nullptr;
+	}
+
+	/* vorbis_synthesis_init builds decode codebooks (fullbooks) lazily inside vorbis_info. Do it now
+	   while nobody else can see this entry so later it is only read. */
+	vorbis_dsp_state vd;
+
+	if( vorbis_synthesis_init( &vd, &pEntry->info ) != 0 )
+	{
+		KLOG( "Can't initialize codebooks" );
+		return nullptr;
+	}
+
+	vorbis_dsp_clear( &vd );
+
+	return pEntry;
+}
+
+} /* namespace KoalaSound */
@@ -0,0 +1,82 @@
+/*
+ * VorbisSetupCache.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef VORBISSETUPCACHE_H_
+#define VORBISSETUPCACHE_H_
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ogg/ogg.h"
+#include <vorbis/codec.h>
+
+namespace KoalaSound
+{
+
+/**
+ * Process wide cache of parsed Vorbis setup headers.
+ *
+ * Files encoded with the same vorbisenc mode carry byte identical identification and setup headers.
+ * Parsing the setup header (_vorbis_unpack_books) and building decode tables (vorbis_book_init_decode)
+ * is the most expensive part of opening a stream so we do it once and share the resulting vorbis_info
+ * between all decoders. Shared vorbis_info is never modified after it is published so it can be used
+ * from many threads at once.
+ */
+class VorbisSetupCache
+{
+public:
+	static VorbisSetupCache& getInstance();
+
+	~VorbisSetupCache();
+
+	//We want block them
+	VorbisSetupCache( VorbisSetupCache const& ) = delete;
+	void operator= ( VorbisSetupCache const& ) = delete;
+
+	/**
+	 * Get vorbis_info for given headers. If we don't have such headers yet they are parsed and stored.
+	 * @param identification bytes of first (identification) header packet
+	 * @param pSetup third (setup) header packet
+	 * @param pComment already parsed comments of this stream. Needed only for header validation.
+	 * @return ready to use vorbis_info (pass it to vorbis_synthesis_init) or nullptr if headers are corrupted.
+	 * 			Don't modify and don't call vorbis_info_clear on it.
+	 */
+	std::shared_ptr<vorbis_info> acquire( const std::vector<unsigned char>& identification,
+										  const ogg_packet* pSetup, vorbis_comment* pComment );
+
+	/**
+	 * Remove all entries that aren't used by any decoder at the moment.
+	 */
+	void purgeUnused();
+
+	/**
+	 * @return count of cached setup headers
+	 */
+	size_t size() const;
+
+	/**
+	 * FNV-1a, used as cache key and to identify shared setup headers.
+	 */
+	static unsigned long long hash( const unsigned char* pData, size_t size );
+
+private:
+	struct Entry;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<unsigned long long, std::shared_ptr<Entry>> m_entries;
+
+	VorbisSetupCache();
+
+	static std::shared_ptr<Entry> createEntry( std::vector<unsigned char>&& key,
+			size_t identificationSize, vorbis_comment* pComment );
+};
+
+} /* namespace KoalaSound */
+
+#endif /* VORBISSETUPCACHE_H_ */
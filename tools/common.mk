@@ -0,0 +1,56 @@
+# Shared part of host tool Makefiles. Tool's Makefile sets TOOL, TOOL_SRC, DECODER_SRC (files in src/decoders),
+# VORBIS_TOOL_SRC (vorbisfile.c or vorbisenc.c) and DEFINES, then includes this file. Run it from tool's
+# directory, e.g. make -C tools/koala_bench
+#
+# libogg's config_types.h in repository is template for configure script, so we generate our own
+# with stdint types.
+
+ROOT := ../..
+BUILD := build
+
+OGG_SRC := $(ROOT)/libogg-1.3.1/src/framing.c $(ROOT)/libogg-1.3.1/src/bitwise.c
+
+VORBIS_SRC := $(addprefix $(ROOT)/libvorbis-1.3.4/lib/,\
+	analysis.c bitrate.c block.c codebook.c envelope.c floor0.c floor1.c info.c lookup.c lpc.c lsp.c\
+	mapping0.c mdct.c psy.c registry.c res0.c sharedbook.c smallft.c synthesis.c window.c $(VORBIS_TOOL_SRC))
+
+INCLUDES := -I$(BUILD)/include -I$(ROOT)/src -I$(ROOT)/libogg-1.3.1/include -I$(ROOT)/libvorbis-1.3.4/include\
+	-I$(ROOT)/libvorbis-1.3.4/lib
+
+CFLAGS ?= -O2
+CXXFLAGS ?= -O2
+LDLIBS += -lm -lpthread
+
+OBJ := $(addprefix $(BUILD)/,$(notdir $(OGG_SRC:.c=.o) $(VORBIS_SRC:.c=.o) $(DECODER_SRC:.cpp=.o) $(TOOL_SRC:.cpp=.o)))
+CONFIG_TYPES := $(BUILD)/include/ogg/config_types.h
+
+vpath %.c $(ROOT)/libogg-1.3.1/src $(ROOT)/libvorbis-1.3.4/lib
+vpath %.cpp $(ROOT)/src/decoders
+
+all: $(TOOL)
+
+$(TOOL): $(OBJ)
+	$(CXX) $(LDFLAGS) -o $@ $^ $(LDLIBS)
+
+$(BUILD)/%.o: %.c $(CONFIG_TYPES)
+	$(CC) $(INCLUDES) $(DEFINES) $(CFLAGS) -w -c -o $@ $<
+
+$(BUILD)/%.o: %.cpp $(CONFIG_TYPES)
+	$(CXX) $(INCLUDES) $(DEFINES) -std=c++11 -Wall $(CXXFLAGS) -c -o $@ $<
+
+$(CONFIG_TYPES):
+	mkdir -p $(dir $@)
+	@echo '#ifndef __CONFIG_TYPES_H__' > $@
+	@echo '#define __CONFIG_TYPES_H__' >> $@
+	@echo '#include <stdint.h>' >> $@
+	@echo 'typedef int16_t ogg_int16_t;' >> $@
+	@echo 'typedef uint16_t ogg_uint16_t;' >> $@
+	@echo 'typedef int32_t ogg_int32_t;' >> $@
+	@echo 'typedef uint32_t ogg_uint32_t;' >> $@
+	@echo 'typedef int64_t ogg_int64_t;' >> $@
+	@echo '#endif' >> $@
+
+clean:
+	rm -rf $(BUILD) $(TOOL)
+
+.PHONY: all clean
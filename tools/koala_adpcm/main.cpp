@@ -0,0 +1,197 @@
+/*
+ * main.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ *
+ * koala_adpcm - host tool converting .ogg assets to IMA-ADPCM sounds for SoundPool::loadAdpcm
+ *
+ * Usage: koala_adpcm [-o output_dir] file.ogg...
+ *
+ * Every file is decoded with OggDecoder (loop points from comments are kept) and written as .ima next to
+ * the input or to output_dir. For every file it prints sizes and signal to noise ratio of the round trip,
+ * so you can decide which sounds survive 4 bit encoding (short SFX usually do, quiet music usually doesn't).
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "decoders/ImaAdpcm.h"
+#include "decoders/OggDecoder.h"
+
+using namespace KoalaSound;
+
+static bool readFile( const std::string& path, std::vector<char>& data )
+{
+	FILE* pFile = fopen( path.c_str(), "rb" );
+
+	if( pFile == nullptr )
+	{
+		return false;
+	}
+
+	char buffer[64 * 1024];
+	size_t read;
+
+	while( ( read = fread( buffer, 1, sizeof( buffer ), pFile ) ) > 0 )
+	{
+		data.insert( data.end(), buffer, buffer + read );
+	}
+
+	fclose( pFile );
+	return data.empty() == false;
+}
+
+static bool writeFile( const std::string& path, const std::vector<char>& data )
+{
+	FILE* pFile = fopen( path.c_str(), "wb" );
+
+	if( pFile == nullptr )
+	{
+		return false;
+	}
+
+	const bool isOk = fwrite( data.data(), 1, data.size(), pFile ) == data.size();
+	return fclose( pFile ) == 0 && isOk;
+}
+
+static std::string getOutputPath( const std::string& input, const std::string& outputDirectory )
+{
+	const size_t slash = input.find_last_of( "/\\" );
+	std::string name = slash == std::string::npos ? input : input.substr( slash + 1 );
+	const size_t dot = name.find_last_of( '.' );
+
+	if( dot != std::string::npos && dot > 0 )
+	{
+		name.erase( dot );
+	}
+
+	std::string directory = outputDirectory;
+
+	if( directory.empty() )
+	{
+		directory = slash == std::string::npos ? "." : input.substr( 0, slash );
+	}
+
+	return directory + "/" + name + ".ima";
+}
+
+/**
+ * @return signal to noise ratio in dB of decoded sound compared to source PCM
+ */
+static double getSnr( const Data& pcm, const std::vector<char>& encoded )
+{
+	ImaAdpcm::Info info;
+	ImaAdpcm::readInfo( encoded.data(), encoded.size(), info );
+
+	std::vector<short> decoded( static_cast<size_t>( info.frames ) * info.channels );
+	ImaAdpcm::decode( encoded.data(), 0, info.frames, decoded.data() );
+
+	const short* pSource = reinterpret_cast<const short*>( pcm.pData );
+	double signal = 0;
+	double noise = 0;
+
+	for( size_t i = 0; i < decoded.size(); ++i )
+	{
+		const double error = static_cast<double>( decoded[i] ) - pSource[i];
+		signal += static_cast<double>( pSource[i] ) * pSource[i];
+		noise += error * error;
+	}
+
+	if( noise == 0 )
+	{
+		return INFINITY;
+	}
+
+	return signal == 0 ? 0 : 10 * log10( signal / noise );
+}
+
+static void printUsage()
+{
+	fprintf( stderr, "Usage: koala_adpcm [-o output_dir] file.ogg...\n" );
+	fprintf( stderr, "  -o  output directory, default: next to input file\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+	std::string outputDirectory;
+	std::vector<std::string> files;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		const std::string argument = argv[i];
+
+		if( argument == "-o" )
+		{
+			if( i + 1 >= argc )
+			{
+				printUsage();
+				return 1;
+			}
+
+			outputDirectory = argv[++i];
+		}
+		else if( argument.size() > 1 && argument[0] == '-' )
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			files.push_back( argument );
+		}
+	}
+
+	if( files.empty() )
+	{
+		printUsage();
+		return 1;
+	}
+
+	OggDecoder decoder;
+	int failed = 0;
+
+	printf( "%-24s %9s %9s %9s %7s %8s\n", "file", "ogg kB", "PCM kB", "IMA kB", "ratio", "SNR dB" );
+
+	for( const std::string& file : files )
+	{
+		std::vector<char> data;
+
+		if( readFile( file, data ) == false )
+		{
+			fprintf( stderr, "FAILED %s: can't read\n", file.c_str() );
+			++failed;
+			continue;
+		}
+
+		Data pcm = decoder.decode( data.data(), data.size() );
+		std::vector<char> encoded;
+
+		if( pcm.pData == nullptr || ImaAdpcm::encode( pcm, encoded ) == false )
+		{
+			fprintf( stderr, "FAILED %s: only mono and stereo .ogg files are supported\n", file.c_str() );
+			delete[] pcm.pData;
+			++failed;
+			continue;
+		}
+
+		const std::string output = getOutputPath( file, outputDirectory );
+
+		if( writeFile( output, encoded ) == false )
+		{
+			fprintf( stderr, "FAILED %s: can't write %s\n", file.c_str(), output.c_str() );
+			delete[] pcm.pData;
+			++failed;
+			continue;
+		}
+
+		printf( "%-24s %9.1f %9.1f %9.1f %6.2fx %8.1f\n", file.c_str(), data.size() / 1024.0, pcm.size / 1024.0,
+				encoded.size() / 1024.0, static_cast<double>( pcm.size ) / encoded.size(), getSnr( pcm, encoded ) );
+
+		delete[] pcm.pData;
+	}
+
+	return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,490 @@
+/*
+ * Kernels.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "Kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+extern "C"
+{
+#include "misc.h"
+#include "window.h"
+}
+
+#include "simd.h"
+
+namespace KoalaSound
+{
+
+/**
+ * Kernel runs on this many separate inputs per pass, 2048 block of stereo channels and their copies stay in L2
+ */
+static const int KERNEL_BLOCKS = 16;
+/**
+ * Samples processed in one run, about 10-30 ms of every kernel
+ */
+static const int KERNEL_RUN_SAMPLES = 1 << 24;
+
+/**
+ * Reference loops must stay scalar, otherwise compiler vectorizes them and we compare SIMD with SIMD
+ */
+#if defined( __clang__ )
+#define SCALAR_REFERENCE
+#define SCALAR_LOOP _Pragma( "clang loop vectorize(disable) interleave(disable)" )
+#elif defined( __GNUC__ )
+#define SCALAR_REFERENCE __attribute__(( optimize( "no-tree-vectorize" ) ))
+#define SCALAR_LOOP
+#else
+#define SCALAR_REFERENCE
+#define SCALAR_LOOP
+#endif
+
+struct KernelTiming
+{
+	double nanoseconds = 0;
+	/**
+	 * Time stamp counter ticks, they run at nominal clock of CPU. -1 where we don't have it.
+	 */
+	double cycles = -1;
+};
+
+static long long getCycles()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+	return static_cast<long long>( __rdtsc() );
+#else
+	return -1;
+#endif
+}
+
+/**
+ * @param restore copies input of all blocks back, it isn't measured
+ * @param kernel called with index of block
+ * @return best time per sample of all runs
+ */
+template<typename Restore, typename Kernel>
+static KernelTiming measureKernel( int runs, int samples, Restore restore, Kernel kernel )
+{
+	KernelTiming best;
+	best.nanoseconds = -1;
+	const bool hasCycles = getCycles() >= 0;
+	const int passes = std::max( 1, KERNEL_RUN_SAMPLES / ( KERNEL_BLOCKS * samples ) );
+	const double count = static_cast<double>( passes ) * KERNEL_BLOCKS * samples;
+
+	for( int run = 0; run < runs; ++run )
+	{
+		double seconds = 0;
+		long long cycles = 0;
+
+		for( int pass = 0; pass < passes; ++pass )
+		{
+			restore();
+			const auto begin = std::chrono::steady_clock::now();
+			const long long beginCycles = getCycles();
+
+			for( int block = 0; block < KERNEL_BLOCKS; ++block )
+			{
+				kernel( block );
+			}
+
+			cycles += getCycles() - beginCycles;
+			seconds += std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+		}
+
+		if( best.nanoseconds < 0 || seconds * 1e9 / count < best.nanoseconds )
+		{
+			best.nanoseconds = seconds * 1e9 / count;
+			best.cycles = hasCycles ? cycles / count : -1;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Block of float samples for every kernel block, with copy to restore it from
+ */
+struct KernelBuffer
+{
+	std::vector<float> samples;
+	std::vector<float> original;
+
+	KernelBuffer( int size, unsigned seed ) :
+		samples( size * KERNEL_BLOCKS )
+		, original( size * KERNEL_BLOCKS )
+	{
+		//Random values of both signs, zeros included, like spectrum or PCM in decoder
+		for( float& value : original )
+		{
+			seed = seed * 1664525U + 1013904223U;
+			value = ( seed >> 24 ) < 16 ? 0.0F : static_cast<int>( seed >> 16 ) / 32768.0F - 1.0F;
+		}
+
+		restore();
+	}
+
+	void restore()
+	{
+		memcpy( samples.data(), original.data(), samples.size() * sizeof( float ) );
+	}
+
+	float* get( int block, int size )
+	{
+		return samples.data() + block * size;
+	}
+};
+
+SCALAR_REFERENCE static void overlapAddScalar( float* pPcm, const float* pNext, const float* pWindow, long n )
+{
+	SCALAR_LOOP
+	for( long i = 0; i < n; i++ )
+	{
+		pPcm[i] = pPcm[i] * pWindow[n - i - 1] + pNext[i] * pWindow[i];
+	}
+}
+
+/**
+ * _vorbis_apply_window of libvorbis 1.3.4
+ */
+SCALAR_REFERENCE static void applyWindowScalar( float* pData, int* pWindowNumbers, long* pBlockSizes, int lW, int W,
+		int nW )
+{
+	lW = W ? lW : 0;
+	nW = W ? nW : 0;
+
+	const float* pWindowLW = _vorbis_window_get( pWindowNumbers[lW] );
+	const float* pWindowNW = _vorbis_window_get( pWindowNumbers[nW] );
+
+	const long n = pBlockSizes[W];
+	const long ln = pBlockSizes[lW];
+	const long rn = pBlockSizes[nW];
+
+	const long leftbegin = n / 4 - ln / 4;
+	const long leftend = leftbegin + ln / 2;
+
+	const long rightbegin = n / 2 + n / 4 - rn / 4;
+	const long rightend = rightbegin + rn / 2;
+
+	long i = 0;
+	long p = 0;
+
+	SCALAR_LOOP
+	for( i = 0; i < leftbegin; i++ )
+	{
+		pData[i] = 0.f;
+	}
+
+	SCALAR_LOOP
+	for( p = 0; i < leftend; i++, p++ )
+	{
+		pData[i] *= pWindowLW[p];
+	}
+
+	SCALAR_LOOP
+	for( i = rightbegin, p = rn / 2 - 1; i < rightend; i++, p-- )
+	{
+		pData[i] *= pWindowNW[p];
+	}
+
+	SCALAR_LOOP
+	for( ; i < n; i++ )
+	{
+		pData[i] = 0.f;
+	}
+}
+
+/**
+ * mapping0.c of libvorbis 1.3.4, the same mag/ang cases as _vorbis_couple_inverse
+ */
+SCALAR_REFERENCE static void coupleScalar( float* pMagnitudes, float* pAngles, long n )
+{
+	SCALAR_LOOP
+	for( long j = 0; j < n; j++ )
+	{
+		const float mag = pMagnitudes[j];
+		const float ang = pAngles[j];
+
+		if( mag > 0 )
+		{
+			if( ang > 0 )
+			{
+				pMagnitudes[j] = mag;
+				pAngles[j] = mag - ang;
+			}
+			else
+			{
+				pAngles[j] = mag;
+				pMagnitudes[j] = mag + ang;
+			}
+		}
+		else
+		{
+			if( ang > 0 )
+			{
+				pMagnitudes[j] = mag;
+				pAngles[j] = mag + ang;
+			}
+			else
+			{
+				pAngles[j] = mag;
+				pMagnitudes[j] = mag - ang;
+			}
+		}
+	}
+}
+
+/**
+ * Stand in for floor1 render_line: dB value steps along the spectrum and is looked up in 256 entry table
+ */
+static float floorLookup[256];
+
+static inline float getFloor( long x )
+{
+	return floorLookup[( x * 7 >> 6 ) & 255];
+}
+
+/**
+ * Floor as decoder applies it now, render_line multiplies spectrum in place
+ */
+SCALAR_REFERENCE static void applyFloorScalar( float* pSpectrum, long n )
+{
+	SCALAR_LOOP
+	for( long x = 0; x < n; x++ )
+	{
+		pSpectrum[x] *= getFloor( x );
+	}
+}
+
+/**
+ * Floor curve for fused pass, it has to be rendered before coupling
+ */
+SCALAR_REFERENCE static void renderFloorScalar( float* pCurve, long n )
+{
+	SCALAR_LOOP
+	for( long x = 0; x < n; x++ )
+	{
+		pCurve[x] = getFloor( x );
+	}
+}
+
+SCALAR_REFERENCE static void multiplyByCurveScalar( float* pSpectrum, const float* pCurve, long n )
+{
+	SCALAR_LOOP
+	for( long x = 0; x < n; x++ )
+	{
+		pSpectrum[x] *= pCurve[x];
+	}
+}
+
+static void printKernel( const char* pName, int samples, double bytes, const KernelTiming& scalar,
+						 const KernelTiming& simd )
+{
+	char scalarCycles[16] = "n/a";
+	char simdCycles[16] = "n/a";
+
+	if( scalar.cycles >= 0 )
+	{
+		snprintf( scalarCycles, sizeof( scalarCycles ), "%.2f", scalar.cycles );
+		snprintf( simdCycles, sizeof( simdCycles ), "%.2f", simd.cycles );
+	}
+
+	printf( "%-28s %7d %9.3f %9.3f %9s %9s %6.1f %9.2f %7.2fx\n", pName, samples, scalar.nanoseconds, simd.nanoseconds,
+			scalarCycles, simdCycles, bytes, bytes / simd.nanoseconds, scalar.nanoseconds / simd.nanoseconds );
+}
+
+/**
+ * Lapping of two blocks in vorbis_synthesis_blockin, n is half of smaller block
+ */
+static void reportOverlapAdd( const char* pName, int n, int windowNumber, int runs )
+{
+	KernelBuffer pcm( n, 1 );
+	KernelBuffer next( n, 2 );
+	const float* pWindow = _vorbis_window_get( windowNumber );
+
+	const KernelTiming scalar = measureKernel( runs, n, [&pcm]()
+	{
+		pcm.restore();
+	}, [&]( int block )
+	{
+		overlapAddScalar( pcm.get( block, n ), next.get( block, n ), pWindow, n );
+	} );
+
+	const KernelTiming simd = measureKernel( runs, n, [&pcm]()
+	{
+		pcm.restore();
+	}, [&]( int block )
+	{
+		_vorbis_window_overlap_add( pcm.get( block, n ), next.get( block, n ), pWindow, n );
+	} );
+
+	//Reads pcm, next and window from both ends, writes pcm
+	printKernel( pName, n, 5 * sizeof( float ), scalar, simd );
+}
+
+/**
+ * Window of whole block before lapping, blocks are of short or long size
+ */
+static void reportApplyWindow( const char* pName, int W, int neighbours, int runs )
+{
+	long blockSizes[2] = { 256, 2048 };
+	//Block of 2^n samples uses window n - 6
+	int windowNumbers[2] = { 2, 5 };
+	const int n = blockSizes[W];
+	KernelBuffer data( n, 3 );
+
+	const KernelTiming scalar = measureKernel( runs, n, [&data]()
+	{
+		data.restore();
+	}, [&]( int block )
+	{
+		applyWindowScalar( data.get( block, n ), windowNumbers, blockSizes, neighbours, W, neighbours );
+	} );
+
+	const KernelTiming simd = measureKernel( runs, n, [&data]()
+	{
+		data.restore();
+	}, [&]( int block )
+	{
+		_vorbis_apply_window( data.get( block, n ), windowNumbers, blockSizes, neighbours, W, neighbours );
+	} );
+
+	//Windowed samples read data and window and write data, others are only zeroed
+	const int lapped = W != 0 && neighbours == 0 ? blockSizes[0] : n;
+	printKernel( pName, n, ( lapped * 3.0 + ( n - lapped ) ) * sizeof( float ) / n, scalar, simd );
+}
+
+/**
+ * Decoupling of stereo pair, n bins of each channel
+ */
+static void reportCouple( const char* pName, int n, int runs )
+{
+	KernelBuffer magnitudes( n, 4 );
+	KernelBuffer angles( n, 5 );
+
+	const auto restore = [&magnitudes, &angles]()
+	{
+		magnitudes.restore();
+		angles.restore();
+	};
+
+	const KernelTiming scalar = measureKernel( runs, n, restore, [&]( int block )
+	{
+		coupleScalar( magnitudes.get( block, n ), angles.get( block, n ), n );
+	} );
+
+	const KernelTiming simd = measureKernel( runs, n, restore, [&]( int block )
+	{
+		_vorbis_couple_inverse( magnitudes.get( block, n ), angles.get( block, n ), n );
+	} );
+
+	//Reads and writes both channels
+	printKernel( pName, n, 4 * sizeof( float ), scalar, simd );
+}
+
+static void printPass( const char* pName, double bytes, const KernelTiming& timing )
+{
+	char cycles[16] = "n/a";
+
+	if( timing.cycles >= 0 )
+	{
+		snprintf( cycles, sizeof( cycles ), "%.2f", timing.cycles );
+	}
+
+	printf( "  %-44s %9.3f %9s %6.1f %9.2f\n", pName, timing.nanoseconds, cycles, bytes, bytes / timing.nanoseconds );
+}
+
+/**
+ * Decoupling and floor of stereo long block as decoder does them, in separate passes, against fused pass. Fused
+ * pass needs floor curves in scratch first. It multiplies every tile right after its decoupling, while it is in
+ * L1, so decoupling is the same SIMD kernel in both and only floor loops differ. They are plain C in both.
+ */
+static void reportCoupleWithFloor( int runs )
+{
+	const int n = 1024;
+	const int tile = 64;
+	KernelBuffer magnitudes( n, 4 );
+	KernelBuffer angles( n, 5 );
+	std::vector<float> magnitudeCurve( n );
+	std::vector<float> angleCurve( n );
+
+	for( int i = 0; i < 256; ++i )
+	{
+		floorLookup[i] = 1.0F / ( 1 + i );
+	}
+
+	const auto restore = [&magnitudes, &angles]()
+	{
+		magnitudes.restore();
+		angles.restore();
+	};
+
+	const KernelTiming separate = measureKernel( runs, n, restore, [&]( int block )
+	{
+		_vorbis_couple_inverse( magnitudes.get( block, n ), angles.get( block, n ), n );
+		applyFloorScalar( magnitudes.get( block, n ), n );
+		applyFloorScalar( angles.get( block, n ), n );
+	} );
+
+	const KernelTiming fused = measureKernel( runs, n, restore, [&]( int block )
+	{
+		float* pMagnitudes = magnitudes.get( block, n );
+		float* pAngles = angles.get( block, n );
+		renderFloorScalar( magnitudeCurve.data(), n );
+		renderFloorScalar( angleCurve.data(), n );
+
+		for( int x = 0; x < n; x += tile )
+		{
+			_vorbis_couple_inverse( pMagnitudes + x, pAngles + x, tile );
+			multiplyByCurveScalar( pMagnitudes + x, magnitudeCurve.data() + x, tile );
+			multiplyByCurveScalar( pAngles + x, angleCurve.data() + x, tile );
+		}
+	} );
+
+	printf( "Decoupling and floor of stereo long block, per bin:\n" );
+	printf( "  %-44s %9s %9s %6s %9s\n", "", "ns", "cyc", "bytes", "GB/s" );
+	//Coupling reads and writes both channels, floor both again
+	printPass( "separate passes, as decoder does", 8 * sizeof( float ), separate );
+	//Curves are written and read, coupling reads and writes both channels
+	printPass( "floor curves in scratch, fused by tiles", 8 * sizeof( float ), fused );
+}
+
+void printKernelReport( int runs )
+{
+#if defined( VORBIS_SIMD_NEON )
+	const char* pSimd = "NEON";
+#elif defined( VORBIS_SIMD_SSE )
+	const char* pSimd = "SSE";
+#else
+	const char* pSimd = "none, libvorbis uses plain C here too";
+#endif
+
+	printf( "Synthesis kernels, per sample, best of %d runs. SIMD: %s\n", runs, pSimd );
+	printf( "Cycles are time stamp counter ticks. Bytes are read and written by kernel, GB/s is of SIMD.\n" );
+	printf( "%-28s %7s %9s %9s %9s %9s %6s %9s %8s\n", "kernel", "samples", "C ns", "SIMD ns", "C cyc",
+			"SIMD cyc", "bytes", "GB/s", "speedup" );
+
+	reportOverlapAdd( "overlap-add long", 1024, 5, runs );
+	reportOverlapAdd( "overlap-add short", 128, 2, runs );
+	reportApplyWindow( "window long, long neighbours", 1, 1, runs );
+	reportApplyWindow( "window long, short neighbours", 1, 0, runs );
+	reportApplyWindow( "window short", 0, 0, runs );
+	reportCouple( "decouple stereo long", 1024, runs );
+	reportCouple( "decouple stereo short", 128, runs );
+
+	printf( "\n" );
+	reportCoupleWithFloor( runs );
+}
+
+} /* namespace KoalaSound */
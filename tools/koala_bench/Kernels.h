@@ -0,0 +1,24 @@
+/*
+ * Kernels.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+namespace KoalaSound
+{
+
+/**
+ * Print time and memory traffic per sample of libvorbis synthesis kernels which got SIMD code, next to plain C
+ * loops they replaced, and of decoupling with floor in separate passes against fused one. Input is synthetic,
+ * of real block sizes, and stays in cache like it does in decoder.
+ * @param runs best of this many runs is printed
+ */
+void printKernelReport( int runs );
+
+} /* namespace KoalaSound */
+
+#endif /* KERNELS_H_ */
@@ -0,0 +1,582 @@
+/*
+ * main.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ *
+ * koala_bench - host tool showing memory vs CPU cost of SoundPool sound types for given .ogg files
+ *
+ * Usage: koala_bench [-r runs] [-v voices] [-l decodes] [-a] file.ogg...
+ *        koala_bench [-r runs] -k
+ *
+ * For every file it prints:
+ *  - resident: SoundPool::load/loadCompressed. PCM stays in memory, decoded once (at load or on cache miss),
+ *    playing costs no CPU.
+ *  - streamed: SoundPool::loadStreamed. Only ogg file stays in memory plus decoder state and chunk buffers
+ *    of every playing voice, decoding runs in audio callback all the time sound plays.
+ *
+ * CPU is measured on this machine, scale it for target device. Times are best of all runs.
+ *
+ * With -l it instead decodes every file given count of times with one OggDecoder and checks that heap in use
+ * doesn't grow. Exit code is 3 if it does.
+ *
+ * With -a it instead counts heap allocations libvorbis makes while decoding every packet of the first link.
+ *
+ * With -k it times libvorbis synthesis kernels which have SIMD code against plain C loops, see Kernels.h.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "Kernels.h"
+#include "decoders/OggDecoder.h"
+#include "decoders/OggStream.h"
+#include <vorbis/codec.h>
+
+using namespace KoalaSound;
+
+/**
+ * Allocations of whole process, -1 if we can't count them. libvorbis allocates by _ogg_malloc, _ogg_calloc
+ * and _ogg_realloc which are malloc, calloc and realloc, glibc lets us replace them.
+ */
+static std::atomic<long long> allocationsCount( 0 );
+
+#ifdef __GLIBC__
+
+extern "C" void* __libc_malloc( size_t size );
+extern "C" void* __libc_calloc( size_t count, size_t size );
+extern "C" void* __libc_realloc( void* pMemory, size_t size );
+extern "C" void __libc_free( void* pMemory );
+
+extern "C" void* malloc( size_t size )
+{
+	allocationsCount.fetch_add( 1, std::memory_order_relaxed );
+	return __libc_malloc( size );
+}
+
+extern "C" void* calloc( size_t count, size_t size )
+{
+	allocationsCount.fetch_add( 1, std::memory_order_relaxed );
+	return __libc_calloc( count, size );
+}
+
+extern "C" void* realloc( void* pMemory, size_t size )
+{
+	allocationsCount.fetch_add( 1, std::memory_order_relaxed );
+	return __libc_realloc( pMemory, size );
+}
+
+extern "C" void free( void* pMemory )
+{
+	__libc_free( pMemory );
+}
+
+static long long getAllocationsCount()
+{
+	return allocationsCount.load( std::memory_order_relaxed );
+}
+
+#else
+
+static long long getAllocationsCount()
+{
+	return -1;
+}
+
+#endif
+
+/**
+ * Same as STREAM_CHUNK_FRAMES and BUFFER_QUEUE_SIZE in SoundPool.cpp
+ */
+static const int STREAM_CHUNK_FRAMES = 4096;
+static const int BUFFER_QUEUE_SIZE = 2;
+
+/**
+ * Heap may grow this much over repeated decodes and it isn't a leak, allocator keeps some freed memory in its
+ * bins. Leak of one small allocation per decode is far above it after thousands of decodes.
+ */
+static const long long HEAP_GROWTH_LIMIT_BYTES = 16 * 1024;
+
+struct Result
+{
+	bool isOk = false;
+	long long frames = 0;
+	int channels = 0;
+	int rate = 0;
+	size_t encodedBytes = 0;
+	size_t pcmBytes = 0;
+	/**
+	 * Heap used by one open OggStream, -1 if we can't measure it on this platform
+	 */
+	long long streamStateBytes = -1;
+	double decodeSeconds = 0;
+	double streamSeconds = 0;
+	double maxChunkSeconds = 0;
+};
+
+struct PacketAllocations
+{
+	int packets = 0;
+	/**
+	 * vorbis_synthesis_init and vorbis_block_init
+	 */
+	long long initAllocations = 0;
+	/**
+	 * vorbis_synthesis, vorbis_synthesis_blockin and reading PCM out of all packets
+	 */
+	long long packetAllocations = 0;
+	int packetsWithAllocations = 0;
+	/**
+	 * -1 if no packet allocated
+	 */
+	int lastPacketWithAllocations = -1;
+};
+
+static bool readFile( const std::string& path, std::vector<char>& data )
+{
+	FILE* pFile = fopen( path.c_str(), "rb" );
+
+	if( pFile == nullptr )
+	{
+		return false;
+	}
+
+	char buffer[64 * 1024];
+	size_t read;
+
+	while( ( read = fread( buffer, 1, sizeof( buffer ), pFile ) ) > 0 )
+	{
+		data.insert( data.end(), buffer, buffer + read );
+	}
+
+	fclose( pFile );
+	return data.empty() == false;
+}
+
+static long long getHeapInUse()
+{
+#if defined( __GLIBC__ ) && ( __GLIBC__ > 2 || __GLIBC_MINOR__ >= 33 )
+	return mallinfo2().uordblks;
+#else
+	return -1;
+#endif
+}
+
+static double getSeconds( std::chrono::steady_clock::time_point begin )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+}
+
+static bool measureDecode( const std::vector<char>& data, Result& result )
+{
+	OggDecoder decoder;
+	const auto begin = std::chrono::steady_clock::now();
+	Data decoded = decoder.decode( data.data(), data.size() );
+	const double seconds = getSeconds( begin );
+
+	if( decoded.pData == nullptr )
+	{
+		return false;
+	}
+
+	result.pcmBytes = decoded.size;
+	result.decodeSeconds = result.decodeSeconds > 0 ? std::min( result.decodeSeconds, seconds ) : seconds;
+	delete[] decoded.pData;
+	return true;
+}
+
+/**
+ * Decode like streamed voice does, one chunk per buffer queue callback.
+ */
+static bool measureStream( const std::vector<char>& data, Result& result )
+{
+	const long long heapBefore = getHeapInUse();
+	OggStream stream;
+	const auto begin = std::chrono::steady_clock::now();
+
+	if( stream.open( data.data(), data.size() ) == false )
+	{
+		return false;
+	}
+
+	if( heapBefore >= 0 )
+	{
+		result.streamStateBytes = getHeapInUse() - heapBefore;
+	}
+
+	result.frames = stream.getLength();
+	result.channels = stream.getChannelsCount();
+	result.rate = stream.getRate();
+
+	std::vector<char> chunk( STREAM_CHUNK_FRAMES * 2 * result.channels );
+	double maxChunkSeconds = 0;
+
+	while( true )
+	{
+		const auto chunkBegin = std::chrono::steady_clock::now();
+		const int frames = stream.read( chunk.data(), STREAM_CHUNK_FRAMES );
+		maxChunkSeconds = std::max( maxChunkSeconds, getSeconds( chunkBegin ) );
+
+		if( frames < 0 )
+		{
+			return false;
+		}
+
+		if( frames == 0 )
+		{
+			break;
+		}
+	}
+
+	const double seconds = getSeconds( begin );
+	result.streamSeconds = result.streamSeconds > 0 ? std::min( result.streamSeconds, seconds ) : seconds;
+	result.maxChunkSeconds = result.maxChunkSeconds > 0 ? std::min( result.maxChunkSeconds, maxChunkSeconds ) :
+							 maxChunkSeconds;
+	return true;
+}
+
+/**
+ * Decode first link of file by libvorbis directly, the same calls as OggDecoder and OggStream make,
+ * and count allocations in every audio packet.
+ */
+static bool countPacketAllocations( const std::vector<char>& data, PacketAllocations& result )
+{
+	ogg_sync_state sync;
+	ogg_sync_init( &sync );
+	memcpy( ogg_sync_buffer( &sync, data.size() ), data.data(), data.size() );
+	ogg_sync_wrote( &sync, data.size() );
+
+	ogg_stream_state stream;
+	vorbis_info info;
+	vorbis_comment comment;
+	vorbis_dsp_state dsp;
+	vorbis_block block;
+	vorbis_info_init( &info );
+	vorbis_comment_init( &comment );
+
+	bool isStreamReady = false;
+	bool isSynthesisReady = false;
+	bool isOk = true;
+	int headers = 0;
+	ogg_page page;
+	ogg_packet packet;
+
+	while( isOk && ogg_sync_pageout( &sync, &page ) == 1 )
+	{
+		if( isStreamReady == false )
+		{
+			ogg_stream_init( &stream, ogg_page_serialno( &page ) );
+			isStreamReady = true;
+		}
+		else if( ogg_page_serialno( &page ) != stream.serialno )
+		{
+			//Next link of chain
+			break;
+		}
+
+		ogg_stream_pagein( &stream, &page );
+
+		while( isOk && ogg_stream_packetout( &stream, &packet ) == 1 )
+		{
+			if( headers < 3 )
+			{
+				isOk = vorbis_synthesis_headerin( &info, &comment, &packet ) == 0;
+
+				if( isOk && ++headers == 3 )
+				{
+					const long long before = getAllocationsCount();
+					isOk = vorbis_synthesis_init( &dsp, &info ) == 0;
+					isSynthesisReady = isOk;
+					isOk = isOk && vorbis_block_init( &dsp, &block ) == 0;
+					result.initAllocations = getAllocationsCount() - before;
+				}
+
+				continue;
+			}
+
+			const long long before = getAllocationsCount();
+
+			if( vorbis_synthesis( &block, &packet ) == 0 )
+			{
+				vorbis_synthesis_blockin( &dsp, &block );
+			}
+
+			float** ppPcm;
+			int frames;
+
+			while( ( frames = vorbis_synthesis_pcmout( &dsp, &ppPcm ) ) > 0 )
+			{
+				vorbis_synthesis_read( &dsp, frames );
+			}
+
+			const long long allocations = getAllocationsCount() - before;
+
+			if( allocations > 0 )
+			{
+				result.packetAllocations += allocations;
+				++result.packetsWithAllocations;
+				result.lastPacketWithAllocations = result.packets;
+			}
+
+			++result.packets;
+		}
+	}
+
+	if( isSynthesisReady )
+	{
+		vorbis_block_clear( &block );
+		vorbis_dsp_clear( &dsp );
+	}
+
+	if( isStreamReady )
+	{
+		ogg_stream_clear( &stream );
+	}
+
+	vorbis_comment_clear( &comment );
+	vorbis_info_clear( &info );
+	ogg_sync_clear( &sync );
+	return isOk && headers == 3;
+}
+
+/**
+ * Decode again and again with one decoder, as SoundPool does on cache misses. Every fourth decode gets whole
+ * file, others file cut in the middle, cut in headers and damaged copy, so error paths run as well.
+ * Decoder keeps its sync buffers and VorbisSetupCache its entries, so heap is compared after first quarter
+ * of decodes.
+ * @return growth of heap in use in bytes, 0 if we can't measure it on this platform
+ */
+static long long measureDecodeHeap( const std::vector<char>& data, int decodes )
+{
+	std::vector<char> damaged = data;
+
+	for( size_t i = damaged.size() / 3; i < damaged.size(); i += 97 )
+	{
+		damaged[i] ^= 0x5a;
+	}
+
+	const char* inputs[] = { data.data(), data.data(), data.data(), damaged.data() };
+	const size_t sizes[] = { data.size(), data.size() / 2, data.size() / 64, damaged.size() };
+
+	OggDecoder decoder;
+	long long heapAfterWarmUp = -1;
+
+	for( int i = 0; i < decodes; ++i )
+	{
+		if( i == decodes / 4 )
+		{
+			heapAfterWarmUp = getHeapInUse();
+		}
+
+		Data decoded = decoder.decode( inputs[i % 4], sizes[i % 4] );
+		delete[] decoded.pData;
+	}
+
+	const long long heap = getHeapInUse();
+	return heap >= 0 && heapAfterWarmUp >= 0 ? heap - heapAfterWarmUp : 0;
+}
+
+static void printUsage()
+{
+	fprintf( stderr, "Usage: koala_bench [-r runs] [-v voices] [-l decodes] [-a] file.ogg...\n" );
+	fprintf( stderr, "       koala_bench [-r runs] -k\n" );
+	fprintf( stderr, "  -r  measure every file this many times and take best time, default: 3\n" );
+	fprintf( stderr, "  -v  count of simultaneously playing voices for totals, default: 4\n" );
+	fprintf( stderr, "  -l  only decode every file this many times and fail if heap in use grows, e.g. 10000\n" );
+	fprintf( stderr, "  -a  only count allocations of libvorbis per decoded packet\n" );
+	fprintf( stderr, "  -k  only time synthesis kernels, SIMD against plain C, no files needed\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+	int runs = 3;
+	int voices = 4;
+	int leakDecodes = 0;
+	bool isCountingAllocations = false;
+	bool isTimingKernels = false;
+	std::vector<std::string> files;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		const std::string argument = argv[i];
+
+		if( ( argument == "-r" || argument == "-v" || argument == "-l" ) && i + 1 >= argc )
+		{
+			printUsage();
+			return 1;
+		}
+
+		if( argument == "-r" )
+		{
+			runs = std::max( 1, atoi( argv[++i] ) );
+		}
+		else if( argument == "-v" )
+		{
+			voices = std::max( 1, atoi( argv[++i] ) );
+		}
+		else if( argument == "-l" )
+		{
+			leakDecodes = std::max( 1, atoi( argv[++i] ) );
+		}
+		else if( argument == "-a" )
+		{
+			isCountingAllocations = true;
+		}
+		else if( argument == "-k" )
+		{
+			isTimingKernels = true;
+		}
+		else if( argument.size() > 1 && argument[0] == '-' )
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			files.push_back( argument );
+		}
+	}
+
+	if( isTimingKernels )
+	{
+		printKernelReport( runs );
+		return 0;
+	}
+
+	if( files.empty() )
+	{
+		printUsage();
+		return 1;
+	}
+
+	if( leakDecodes > 0 )
+	{
+		if( getHeapInUse() < 0 )
+		{
+			fprintf( stderr, "Heap in use can't be measured on this platform\n" );
+			return 1;
+		}
+
+		int grown = 0;
+
+		for( const std::string& file : files )
+		{
+			std::vector<char> data;
+
+			if( readFile( file, data ) == false )
+			{
+				fprintf( stderr, "FAILED %s\n", file.c_str() );
+				return 2;
+			}
+
+			const long long growth = measureDecodeHeap( data, leakDecodes );
+			const bool isOk = growth <= HEAP_GROWTH_LIMIT_BYTES;
+			printf( "%-24s %d decodes, heap after warm-up %+lld bytes %s\n", file.c_str(), leakDecodes, growth,
+					isOk ? "ok" : "GROWS" );
+			grown += isOk ? 0 : 1;
+		}
+
+		return grown == 0 ? 0 : 3;
+	}
+
+	if( isCountingAllocations )
+	{
+		if( getAllocationsCount() < 0 )
+		{
+			fprintf( stderr, "Allocations can't be counted on this platform\n" );
+			return 1;
+		}
+
+		int failed = 0;
+
+		for( const std::string& file : files )
+		{
+			std::vector<char> data;
+			PacketAllocations result;
+
+			//Streams without setup header need OggDecoder::setSharedSetupHeader, they fail here
+			if( readFile( file, data ) == false || countPacketAllocations( data, result ) == false )
+			{
+				fprintf( stderr, "FAILED %s\n", file.c_str() );
+				++failed;
+				continue;
+			}
+
+			printf( "%-24s %d packets, %lld allocations in synthesis init, %lld in packets (%.3f per packet)\n",
+					file.c_str(), result.packets, result.initAllocations, result.packetAllocations,
+					result.packets > 0 ? static_cast<double>( result.packetAllocations ) / result.packets : 0 );
+
+			if( result.packetsWithAllocations > 0 )
+			{
+				printf( "  %d packets allocated, last one is packet %d\n", result.packetsWithAllocations,
+						result.lastPacketWithAllocations );
+			}
+		}
+
+		return failed == 0 ? 0 : 2;
+	}
+
+	const int streamBuffersBytes = BUFFER_QUEUE_SIZE * STREAM_CHUNK_FRAMES * 2;
+	int failed = 0;
+
+	printf( "%-24s %7s %9s %9s %9s %10s %9s %9s\n", "file", "audio", "ogg kB", "PCM kB", "voice kB",
+			"decode ms", "CPU %", "chunk ms" );
+
+	for( const std::string& file : files )
+	{
+		std::vector<char> data;
+		Result result;
+		result.isOk = readFile( file, data );
+
+		for( int run = 0; run < runs && result.isOk; ++run )
+		{
+			result.isOk = measureDecode( data, result ) && measureStream( data, result );
+		}
+
+		if( result.isOk == false || result.rate < 1 )
+		{
+			fprintf( stderr, "FAILED %s\n", file.c_str() );
+			++failed;
+			continue;
+		}
+
+		result.encodedBytes = data.size();
+		const double duration = static_cast<double>( result.frames ) / result.rate;
+		const long long voiceBytes = result.streamStateBytes < 0 ? -1 :
+									 result.streamStateBytes + streamBuffersBytes * result.channels;
+
+		/* CPU % is one streamed voice decoding in real time. Chunk ms is the longest single callback. */
+		printf( "%-24s %6.2fs %9.1f %9.1f %9s %10.2f %9.2f %9.3f\n", file.c_str(), duration,
+				result.encodedBytes / 1024.0, result.pcmBytes / 1024.0,
+				voiceBytes < 0 ? "n/a" : std::to_string( voiceBytes / 1024 ).c_str(), result.decodeSeconds * 1000,
+				100 * result.streamSeconds / duration, result.maxChunkSeconds * 1000 );
+
+		printf( "  %d voices resident: %.1f kB, 0%% CPU while playing, %.2f ms decode on load or cache miss\n",
+				voices, result.pcmBytes / 1024.0, result.decodeSeconds * 1000 );
+
+		if( voiceBytes < 0 )
+		{
+			printf( "  %d voices streamed: %.1f kB + decoder state, %.2f%% CPU while playing\n", voices,
+					( result.encodedBytes + voices * streamBuffersBytes * result.channels ) / 1024.0,
+					voices * 100 * result.streamSeconds / duration );
+		}
+		else
+		{
+			printf( "  %d voices streamed: %.1f kB, %.2f%% CPU while playing\n", voices,
+					( result.encodedBytes + voices * voiceBytes ) / 1024.0,
+					voices * 100 * result.streamSeconds / duration );
+		}
+	}
+
+	return failed == 0 ? 0 : 2;
+}
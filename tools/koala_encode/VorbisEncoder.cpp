@@ -0,0 +1,167 @@
+/*
+ * VorbisEncoder.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "VorbisEncoder.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <vorbis/vorbisenc.h>
+
+#include "WavFile.h"
+#include "decoders/VorbisSetupCache.h"
+
+namespace KoalaSound
+{
+
+/**
+ * How many frames we pass to vorbis_analysis_buffer at once
+ */
+static const int ANALYSIS_FRAMES = 1024;
+
+static void appendPage( const ogg_page& page, std::vector<char>& output )
+{
+	output.insert( output.end(), page.header, page.header + page.header_len );
+	output.insert( output.end(), page.body, page.body + page.body_len );
+}
+
+VorbisEncoder::VorbisEncoder( const Options& options ) :
+	m_options( options )
+{
+}
+
+VorbisEncoder::~VorbisEncoder()
+{
+}
+
+bool VorbisEncoder::encode( const WavFile& wav, std::vector<char>& output, std::string& error )
+{
+	output.clear();
+
+	vorbis_info vi;
+	vorbis_info_init( &vi );
+
+	int draft = m_options.isDraft ? 1 : 0;
+
+	if( vorbis_encode_setup_vbr( &vi, wav.channels, wav.rate, m_options.quality ) != 0
+			|| vorbis_encode_ctl( &vi, OV_ECTL_DRAFT_SET, &draft ) != 0
+			|| vorbis_encode_setup_init( &vi ) != 0 )
+	{
+		vorbis_info_clear( &vi );
+		error = "unsupported channels/rate/quality combination";
+		return false;
+	}
+
+	vorbis_comment vc;
+	vorbis_comment_init( &vc );
+	vorbis_comment_add_tag( &vc, "ENCODER", "koala_encode" );
+
+	vorbis_dsp_state vd;
+	vorbis_block vb;
+	vorbis_analysis_init( &vd, &vi );
+	vorbis_block_init( &vd, &vb );
+
+	ogg_stream_state os;
+	ogg_stream_init( &os, m_options.serial );
+
+	ogg_packet header;
+	ogg_packet headerComment;
+	ogg_packet headerCode;
+	vorbis_analysis_headerout( &vd, &vc, &header, &headerComment, &headerCode );
+	m_setupHeader.assign( headerCode.packet, headerCode.packet + headerCode.bytes );
+	ogg_stream_packetin( &os, &header );
+
+	if( m_options.isSetupShared )
+	{
+		//Decoder checks this tag so it won't decode with setup header of other bank
+		const unsigned long long setupHash = VorbisSetupCache::hash( m_setupHeader.data(), m_setupHeader.size() );
+		char hash[32];
+		snprintf( hash, sizeof( hash ), "%016llx", setupHash );
+		vorbis_comment_add_tag( &vc, "KOALA_SETUP", hash );
+
+		ogg_packet comment;
+		vorbis_commentheader_out( &vc, &comment );
+		ogg_stream_packetin( &os, &comment );
+		ogg_packet_clear( &comment );
+	}
+	else
+	{
+		ogg_stream_packetin( &os, &headerComment );
+		ogg_stream_packetin( &os, &headerCode );
+	}
+
+	ogg_page page;
+
+	//Audio must start on new page
+	while( ogg_stream_flush( &os, &page ) != 0 )
+	{
+		appendPage( page, output );
+	}
+
+	const long long framesCount = wav.getFramesCount();
+	long long frame = 0;
+	bool isEnd = false;
+
+	while( isEnd == false )
+	{
+		const int frames = static_cast<int>( std::min<long long>( ANALYSIS_FRAMES, framesCount - frame ) );
+
+		if( frames == 0 )
+		{
+			//Let libvorbis finish last block and mark end of stream
+			vorbis_analysis_wrote( &vd, 0 );
+		}
+		else
+		{
+			float** pBuffer = vorbis_analysis_buffer( &vd, frames );
+			const short* pSamples = wav.samples.data() + frame * wav.channels;
+
+			for( int i = 0; i < frames; ++i )
+			{
+				for( int channel = 0; channel < wav.channels; ++channel )
+				{
+					pBuffer[channel][i] = pSamples[i * wav.channels + channel] / 32768.F;
+				}
+			}
+
+			vorbis_analysis_wrote( &vd, frames );
+			frame += frames;
+		}
+
+		while( vorbis_analysis_blockout( &vd, &vb ) == 1 )
+		{
+			vorbis_analysis( &vb, nullptr );
+			vorbis_bitrate_addblock( &vb );
+
+			ogg_packet packet;
+
+			while( vorbis_bitrate_flushpacket( &vd, &packet ) )
+			{
+				ogg_stream_packetin( &os, &packet );
+
+				while( ogg_stream_pageout( &os, &page ) != 0 )
+				{
+					appendPage( page, output );
+
+					if( ogg_page_eos( &page ) )
+					{
+						isEnd = true;
+					}
+				}
+			}
+		}
+	}
+
+	ogg_stream_clear( &os );
+	vorbis_block_clear( &vb );
+	vorbis_dsp_clear( &vd );
+	vorbis_comment_clear( &vc );
+	vorbis_info_clear( &vi );
+	return true;
+}
+
+} /* namespace KoalaSound */
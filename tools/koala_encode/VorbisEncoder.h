@@ -0,0 +1,77 @@
+/*
+ * VorbisEncoder.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef VORBISENCODER_H_
+#define VORBISENCODER_H_
+
+#include <string>
+#include <vector>
+
+namespace KoalaSound
+{
+
+struct WavFile;
+
+/**
+ * Encodes whole PCM buffer to .ogg file in memory. Every instance has its own libvorbis state so
+ * separate instances can run on separate threads.
+ */
+class VorbisEncoder
+{
+public:
+	struct Options
+	{
+		/**
+		 * VBR quality, from -0.1 to 1.0
+		 */
+		float quality = 0.4F;
+		/**
+		 * Serial number of logical stream. For the same input and serial output is byte identical.
+		 */
+		int serial = 0;
+		/**
+		 * Use cheaper psychoacoustic model (OV_ECTL_DRAFT_SET). Faster, a bit worse quality. For iteration builds.
+		 */
+		bool isDraft = false;
+		/**
+		 * Leave setup header (codebooks) out of stream. Decoder must get it by OggDecoder::setSharedSetupHeader.
+		 * All files encoded with the same quality, channels count and rate have the same setup header.
+		 */
+		bool isSetupShared = false;
+	};
+
+	explicit VorbisEncoder( const Options& options );
+	~VorbisEncoder();
+
+	//We want block them
+	VorbisEncoder( VorbisEncoder const& ) = delete;
+	void operator= ( VorbisEncoder const& ) = delete;
+
+	/**
+	 * @param wav PCM to encode
+	 * @param output encoded .ogg file, previous content is replaced
+	 * @param error filled with description if encoding fails
+	 * @return true if everything is ok, false otherwise
+	 */
+	bool encode( const WavFile& wav, std::vector<char>& output, std::string& error );
+
+	/**
+	 * @return setup header packet of last encoded file
+	 */
+	inline const std::vector<unsigned char>& getSetupHeader() const
+	{
+		return m_setupHeader;
+	}
+
+private:
+	Options m_options;
+	std::vector<unsigned char> m_setupHeader;
+};
+
+} /* namespace KoalaSound */
+
+#endif /* VORBISENCODER_H_ */
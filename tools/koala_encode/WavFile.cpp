@@ -0,0 +1,114 @@
+/*
+ * WavFile.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#include "WavFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace KoalaSound
+{
+
+static unsigned int readLE32( const unsigned char* pData )
+{
+	return pData[0] | ( pData[1] << 8 ) | ( pData[2] << 16 ) | ( static_cast<unsigned int>( pData[3] ) << 24 );
+}
+
+static unsigned int readLE16( const unsigned char* pData )
+{
+	return pData[0] | ( pData[1] << 8 );
+}
+
+bool WavFile::load( const std::string& path, std::string& error )
+{
+	FILE* pFile = fopen( path.c_str(), "rb" );
+
+	if( pFile == nullptr )
+	{
+		error = "can't open file";
+		return false;
+	}
+
+	std::vector<unsigned char> data;
+	unsigned char chunk[64 * 1024];
+	size_t readed;
+
+	while( ( readed = fread( chunk, 1, sizeof( chunk ), pFile ) ) > 0 )
+	{
+		data.insert( data.end(), chunk, chunk + readed );
+	}
+
+	fclose( pFile );
+
+	if( data.size() < 12 || memcmp( data.data(), "RIFF", 4 ) != 0 || memcmp( data.data() + 8, "WAVE", 4 ) != 0 )
+	{
+		error = "not a RIFF/WAVE file";
+		return false;
+	}
+
+	bool hasFormat = false;
+	size_t offset = 12;
+
+	while( offset + 8 <= data.size() )
+	{
+		const unsigned char* pChunk = data.data() + offset;
+		const size_t chunkSize = readLE32( pChunk + 4 );
+		const size_t available = std::min( chunkSize, data.size() - offset - 8 );
+
+		if( memcmp( pChunk, "fmt ", 4 ) == 0 )
+		{
+			if( available < 16 )
+			{
+				error = "broken fmt chunk";
+				return false;
+			}
+
+			const unsigned int format = readLE16( pChunk + 8 );
+			channels = readLE16( pChunk + 10 );
+			rate = readLE32( pChunk + 12 );
+			const unsigned int bits = readLE16( pChunk + 22 );
+
+			if( format != 1 || bits != 16 || channels < 1 || rate < 1 )
+			{
+				error = "only 16 bit PCM is supported";
+				return false;
+			}
+
+			hasFormat = true;
+		}
+		else if( memcmp( pChunk, "data", 4 ) == 0 )
+		{
+			if( hasFormat == false )
+			{
+				error = "data chunk before fmt chunk";
+				return false;
+			}
+
+			const size_t frameSize = 2 * channels;
+			const size_t bytes = available - available % frameSize;
+			const unsigned char* pSamples = pChunk + 8;
+
+			samples.resize( bytes / 2 );
+
+			for( size_t i = 0; i < samples.size(); ++i )
+			{
+				samples[i] = static_cast<short>( readLE16( pSamples + 2 * i ) );
+			}
+
+			return true;
+		}
+
+		//Chunks are word aligned
+		offset += 8 + chunkSize + ( chunkSize & 1 );
+	}
+
+	error = "missing data chunk";
+	return false;
+}
+
+} /* namespace KoalaSound */
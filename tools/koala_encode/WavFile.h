@@ -0,0 +1,42 @@
+/*
+ * WavFile.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ */
+
+#ifndef WAVFILE_H_
+#define WAVFILE_H_
+
+#include <string>
+#include <vector>
+
+namespace KoalaSound
+{
+
+/**
+ * Uncompressed 16 bit PCM loaded from .wav file. Samples are interleaved.
+ */
+struct WavFile
+{
+	int channels = 0;
+	int rate = 0;
+	std::vector<short> samples;
+
+	inline long long getFramesCount() const
+	{
+		return channels > 0 ? samples.size() / channels : 0;
+	}
+
+	/**
+	 * Load RIFF/WAVE file. Only 16 bit PCM (format tag 1) is supported, it is what our sound designers export.
+	 * @param path path to .wav file
+	 * @param error filled with description if loading fails
+	 * @return true if everything is ok, false otherwise
+	 */
+	bool load( const std::string& path, std::string& error );
+};
+
+} /* namespace KoalaSound */
+
+#endif /* WAVFILE_H_ */
@@ -0,0 +1,392 @@
+/*
+ * main.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: dawid
+ *
+ * koala_encode - host tool for baking .wav assets to .ogg
+ *
+ * Usage: koala_encode [-j threads] [-q quality] [-d] [-s setup_file] [-o output_dir] file.wav...
+ *
+ * Build with "make PROFILE=1" to get time spent in every encoder stage.
+ *
+ * With -s streams are written without setup header (codebooks, usually 3-4kB) and the header is written once
+ * to setup_file. Load it with OggDecoder::setSharedSetupHeader. All files of such bank must be encoded in
+ * one run with the same quality, channels count and rate, otherwise they are rejected.
+ *
+ * Files are encoded concurrently, one file per thread. Output of every file depends only on its content,
+ * quality and name (serial number is hash of the name) so it is byte identical no matter how many
+ * threads are used.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "VorbisEncoder.h"
+#include "WavFile.h"
+#include "profile.h"
+
+using namespace KoalaSound;
+
+struct Job
+{
+	std::string input;
+	std::string output;
+	int serial = 0;
+
+	bool isOk = false;
+	std::string error;
+	long long frames = 0;
+	int rate = 0;
+	size_t inputBytes = 0;
+	size_t outputBytes = 0;
+	double seconds = 0;
+	double encodeSeconds = 0;
+	double stageSeconds[VP_PROFILE_STAGES] = {};
+	std::vector<unsigned char> setupHeader;
+};
+
+/**
+ * FNV-1a of file name. Gives every asset stable and most likely unique serial number.
+ */
+static int serialFromName( const std::string& name )
+{
+	unsigned int hash = 2166136261U;
+
+	for( unsigned char c : name )
+	{
+		hash ^= c;
+		hash *= 16777619U;
+	}
+
+	return static_cast<int>( hash & 0x7fffffff );
+}
+
+static std::string getBaseName( const std::string& path )
+{
+	const size_t slash = path.find_last_of( "/\\" );
+	std::string name = slash == std::string::npos ? path : path.substr( slash + 1 );
+	const size_t dot = name.find_last_of( '.' );
+
+	if( dot != std::string::npos && dot > 0 )
+	{
+		name.erase( dot );
+	}
+
+	return name;
+}
+
+static bool writeFile( const std::string& path, const std::vector<char>& data )
+{
+	FILE* pFile = fopen( path.c_str(), "wb" );
+
+	if( pFile == nullptr )
+	{
+		return false;
+	}
+
+	const bool isOk = fwrite( data.data(), 1, data.size(), pFile ) == data.size();
+	return fclose( pFile ) == 0 && isOk;
+}
+
+static void runJob( Job& job, const VorbisEncoder::Options& defaultOptions )
+{
+	const auto begin = std::chrono::steady_clock::now();
+
+	WavFile wav;
+
+	if( wav.load( job.input, job.error ) == false )
+	{
+		return;
+	}
+
+	job.frames = wav.getFramesCount();
+	job.rate = wav.rate;
+	job.inputBytes = wav.samples.size() * sizeof( short );
+
+	VorbisEncoder::Options options = defaultOptions;
+	options.serial = job.serial;
+
+	VorbisEncoder encoder( options );
+	std::vector<char> output;
+
+	//Profile counters are per thread and this job is the only one on this thread now
+	_vp_profile_reset();
+	const auto encodeBegin = std::chrono::steady_clock::now();
+
+	if( encoder.encode( wav, output, job.error ) == false )
+	{
+		return;
+	}
+
+	job.encodeSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - encodeBegin ).count();
+	job.setupHeader = encoder.getSetupHeader();
+
+	for( int stage = 0; stage < VP_PROFILE_STAGES; ++stage )
+	{
+		job.stageSeconds[stage] = _vp_profile_seconds( stage );
+	}
+
+	if( writeFile( job.output, output ) == false )
+	{
+		job.error = "can't write " + job.output;
+		return;
+	}
+
+	job.outputBytes = output.size();
+	job.seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+	job.isOk = true;
+}
+
+/**
+ * Write setup header shared by all streams. Streams which need other setup header are rejected and removed.
+ */
+static bool writeSharedSetup( const std::string& path, std::vector<Job>& jobs )
+{
+	const Job* pReference = nullptr;
+	int streams = 0;
+
+	for( Job& job : jobs )
+	{
+		if( job.isOk == false )
+		{
+			continue;
+		}
+
+		if( pReference == nullptr )
+		{
+			pReference = &job;
+		}
+
+		if( job.setupHeader != pReference->setupHeader )
+		{
+			job.isOk = false;
+			job.error = "setup header differs from " + pReference->input +
+						", use the same quality, channels and rate for whole bank";
+			remove( job.output.c_str() );
+			continue;
+		}
+
+		++streams;
+	}
+
+	if( pReference == nullptr )
+	{
+		return true;
+	}
+
+	const std::vector<char> data( pReference->setupHeader.begin(), pReference->setupHeader.end() );
+
+	if( writeFile( path, data ) == false )
+	{
+		fprintf( stderr, "Can't write setup header to %s\n", path.c_str() );
+		return false;
+	}
+
+	printf( "Shared setup header: %s (%d bytes, saved %d bytes in %d streams)\n", path.c_str(),
+			static_cast<int>( data.size() ), static_cast<int>( data.size() * ( streams - 1 ) ), streams );
+	return true;
+}
+
+static void printUsage()
+{
+	fprintf( stderr, "Usage: koala_encode [-j threads] [-q quality] [-d] [-s setup_file] [-o output_dir] file.wav...\n" );
+	fprintf( stderr, "  -j  count of encoding threads, default: hardware concurrency\n" );
+	fprintf( stderr, "  -q  vorbis VBR quality from -0.1 to 1.0, default: 0.4\n" );
+	fprintf( stderr, "  -d  draft: cheaper psychoacoustic model, faster but lower quality\n" );
+	fprintf( stderr, "  -s  write setup header once to setup_file and leave it out of all streams\n" );
+	fprintf( stderr, "  -o  output directory, default: next to input file\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+	VorbisEncoder::Options options;
+	int threadsCount = std::max( 1U, std::thread::hardware_concurrency() );
+	std::string outputDirectory;
+	std::string setupPath;
+	std::vector<Job> jobs;
+
+	for( int i = 1; i < argc; ++i )
+	{
+		const std::string argument = argv[i];
+
+		if( ( argument == "-j" || argument == "-q" || argument == "-o" || argument == "-s" ) && i + 1 >= argc )
+		{
+			printUsage();
+			return 1;
+		}
+
+		if( argument == "-j" )
+		{
+			threadsCount = std::max( 1, atoi( argv[++i] ) );
+		}
+		else if( argument == "-q" )
+		{
+			options.quality = static_cast<float>( atof( argv[++i] ) );
+		}
+		else if( argument == "-d" )
+		{
+			options.isDraft = true;
+		}
+		else if( argument == "-o" )
+		{
+			outputDirectory = argv[++i];
+		}
+		else if( argument == "-s" )
+		{
+			setupPath = argv[++i];
+			options.isSetupShared = true;
+		}
+		else if( argument.size() > 1 && argument[0] == '-' )
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			Job job;
+			job.input = argument;
+			jobs.push_back( job );
+		}
+	}
+
+	if( jobs.empty() )
+	{
+		printUsage();
+		return 1;
+	}
+
+	for( Job& job : jobs )
+	{
+		const std::string name = getBaseName( job.input );
+		std::string directory = outputDirectory;
+
+		if( directory.empty() )
+		{
+			const size_t slash = job.input.find_last_of( "/\\" );
+			directory = slash == std::string::npos ? "." : job.input.substr( 0, slash );
+		}
+
+		job.output = directory + "/" + name + ".ogg";
+		job.serial = serialFromName( name );
+	}
+
+	//E.g. a/hit.wav and b/hit.wav with -o, threads would write the same file and both get the same serial
+	std::map<std::string, const Job*> outputs;
+
+	for( const Job& job : jobs )
+	{
+		const auto inserted = outputs.insert( std::make_pair( job.output, &job ) );
+
+		if( inserted.second == false )
+		{
+			fprintf( stderr, "Both %s and %s would be written to %s, rename one of them\n",
+					 inserted.first->second->input.c_str(), job.input.c_str(), job.output.c_str() );
+			return 1;
+		}
+	}
+
+	threadsCount = std::min<int>( threadsCount, jobs.size() );
+
+	const auto begin = std::chrono::steady_clock::now();
+
+	//Longest files aren't sorted first, for SFX libraries files are similar and order keeps output predictable
+	std::atomic<size_t> nextJob( 0 );
+	std::vector<std::thread> threads;
+
+	for( int i = 0; i < threadsCount; ++i )
+	{
+		threads.emplace_back( [&jobs, &nextJob, &options]()
+		{
+			for( size_t index = nextJob++; index < jobs.size(); index = nextJob++ )
+			{
+				runJob( jobs[index], options );
+			}
+		} );
+	}
+
+	for( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+
+	const double wallSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+
+	if( setupPath.empty() == false && writeSharedSetup( setupPath, jobs ) == false )
+	{
+		return 2;
+	}
+
+	int failed = 0;
+	double audioSeconds = 0;
+	double cpuSeconds = 0;
+	double encodeSeconds = 0;
+	double stageSeconds[VP_PROFILE_STAGES] = {};
+	size_t inputBytes = 0;
+	size_t outputBytes = 0;
+
+	for( const Job& job : jobs )
+	{
+		if( job.isOk == false )
+		{
+			fprintf( stderr, "FAILED %s: %s\n", job.input.c_str(), job.error.c_str() );
+			++failed;
+			continue;
+		}
+
+		const double duration = static_cast<double>( job.frames ) / job.rate;
+		printf( "%s -> %s (%.2fs audio, %.2fs, %.1fx realtime)\n", job.input.c_str(), job.output.c_str(),
+				duration, job.seconds, job.seconds > 0 ? duration / job.seconds : 0 );
+
+		audioSeconds += duration;
+		cpuSeconds += job.seconds;
+		encodeSeconds += job.encodeSeconds;
+
+		for( int stage = 0; stage < VP_PROFILE_STAGES; ++stage )
+		{
+			stageSeconds[stage] += job.stageSeconds[stage];
+		}
+		inputBytes += job.inputBytes;
+		outputBytes += job.outputBytes;
+	}
+
+	printf( "Encoded %d/%d files on %d threads in %.2fs\n", static_cast<int>( jobs.size() ) - failed,
+			static_cast<int>( jobs.size() ), threadsCount, wallSeconds );
+
+	if( wallSeconds > 0 )
+	{
+		printf( "Throughput: %.1f files/s, %.1fx realtime, %.2f MB/s PCM in, %.2f MB/s ogg out, %.2fx parallel speedup\n",
+				( jobs.size() - failed ) / wallSeconds, audioSeconds / wallSeconds,
+				inputBytes / wallSeconds / ( 1024 * 1024 ), outputBytes / wallSeconds / ( 1024 * 1024 ),
+				cpuSeconds / wallSeconds );
+	}
+
+#ifdef VORBIS_PROFILE
+
+	if( encodeSeconds > 0 )
+	{
+		double profiled = 0;
+		printf( "Encoder profile (CPU time summed over all threads):\n" );
+
+		for( int stage = 0; stage < VP_PROFILE_STAGES; ++stage )
+		{
+			printf( "  %-20s %8.3fs %5.1f%%\n", _vp_profile_name( stage ), stageSeconds[stage],
+					100 * stageSeconds[stage] / encodeSeconds );
+			profiled += stageSeconds[stage];
+		}
+
+		printf( "  %-20s %8.3fs %5.1f%%\n", "other", encodeSeconds - profiled,
+				100 * ( encodeSeconds - profiled ) / encodeSeconds );
+	}
+
+#endif
+
+	return failed == 0 ? 0 : 2;
+}